@@ -0,0 +1,197 @@
+// Headless benchmark of the receive pipeline: IQ conversion, window + FFT,
+// dB stage, averaging, waterfall rows, display reduction and the SSB
+// receiver, driven from the synthetic band generator or an IQ file. No
+// SDL, ImGui, PortAudio or Pluto needed.
+//
+// Usage: pluto17-bench [--n 4096] [--rate 576000] [--seconds 10]
+//                      [--file recording.sigmf-meta] [--scenario band.txt]
+//                      [--rigor estimate|measure|patient]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "dsp.h"
+#include "iqconvert.h"
+#include "averager.h"
+#include "waterfall.h"
+#include "reducer.h"
+#include "playback.h"
+#include "generator.h"
+
+typedef std::chrono::steady_clock benchClock;
+
+struct stage {
+    const char *name;
+    std::vector<double> ns; // Per block
+};
+
+static double percentile(std::vector<double> values, double p)
+{
+    if(values.empty()) {
+        return 0.0;
+    }
+    size_t k = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+static double peakRssMb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1'000'000.0; // Bytes
+#else
+    return usage.ru_maxrss / 1'000.0; // Kilobytes
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t N = 4096;
+    double rate = 576'000.0;
+    double seconds = 10.0;
+    std::string file;
+    std::string scenario;
+    fftPlannerBase::rigor rigor = fftPlannerBase::MEASURE;
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if(arg == "--n" && value) {
+            N = std::strtoull(value, nullptr, 10);
+            i++;
+        } else if(arg == "--rate" && value) {
+            rate = std::strtod(value, nullptr);
+            i++;
+        } else if(arg == "--seconds" && value) {
+            seconds = std::strtod(value, nullptr);
+            i++;
+        } else if(arg == "--file" && value) {
+            file = value;
+            i++;
+        } else if(arg == "--scenario" && value) {
+            scenario = value;
+            i++;
+        } else if(arg == "--rigor" && value) {
+            std::string r = value;
+            rigor = r == "estimate" ? fftPlannerBase::ESTIMATE : r == "patient" ? fftPlannerBase::PATIENT : fftPlannerBase::MEASURE;
+            i++;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--n 4096] [--rate 576000] [--seconds 10] [--file path] [--scenario path] [--rigor estimate|measure|patient]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Source: a file (looped) or the synthetic band, the source stage shows
+    // what either costs:
+    playback player;
+    if(!file.empty()) {
+        if(!player.open(file, rate)) {
+            return 1;
+        }
+        player.setLoop(true);
+        rate = player.getSampleRate();
+    }
+    generator synthetic(rate);
+    if(file.empty() && !synthetic.load(scenario)) {
+        return 1;
+    }
+    sampleSource *source = file.empty() ? static_cast<sampleSource*>(&synthetic) : &player;
+
+    fftPlanner<spectrumSample>::instance().setRigor(rigor);
+    spectrumFft fourier(N);
+    spectrumAverager averager(N, spectrumAverager::EXPONENTIAL, 10);
+    waterfall rows(N);
+    spectrumReducer reducer;
+    ssb receiver(rate, N);
+    std::vector<int16_t> block(2 * N);
+    std::vector<float> receiverIn(2 * N);
+
+    stage stages[] = {
+        {"source", {}},
+        {"convert", {}},
+        {"fft", {}},
+        {"dB", {}},
+        {"average", {}},
+        {"waterfall", {}},
+        {"reduce", {}},
+        {"ssb", {}},
+    };
+    const size_t stageCount = sizeof(stages) / sizeof(stages[0]);
+    uint64_t blocks = std::max<uint64_t>(1, static_cast<uint64_t>(seconds * rate / N));
+    for(auto &s : stages) {
+        s.ns.reserve(blocks);
+    }
+    std::vector<double> total;
+    total.reserve(blocks);
+
+    std::cout << "N " << N << ", " << rate / 1'000.0 << " kS/s, " << blocks << " blocks, "
+              << (file.empty() ? synthetic.getScenario() : file) << ", IQ conversion: " << iqConvertKernel() << std::endl;
+
+    auto begin = benchClock::now();
+    for(uint64_t b = 0; b < blocks; b++) {
+        benchClock::time_point t[stageCount + 1];
+        t[0] = benchClock::now();
+
+        source->read(block.data(), N);
+        t[1] = benchClock::now();
+
+        convertIq(block.data(), N, reinterpret_cast<spectrumSample*>(fourier.in));
+        convertIq(block.data(), N, reinterpret_cast<float*>(receiver.in.data()));
+        t[2] = benchClock::now();
+
+        fourier.transform();
+        t[3] = benchClock::now();
+
+        fourier.powerSpectrum();
+        t[4] = benchClock::now();
+
+        averager.add(fourier.getSpectrum());
+        t[5] = benchClock::now();
+
+        rows.addRow(averager.getAverage());
+        t[6] = benchClock::now();
+
+        reducer.build(averager.getAverage(), N);
+        reducer.reduce(0.0, static_cast<double>(N - 1), 1920);
+        t[7] = benchClock::now();
+
+        receiver.demodulate(10'000.0, N);
+        t[8] = benchClock::now();
+
+        for(size_t s = 0; s < stageCount; s++) {
+            stages[s].ns.push_back(std::chrono::duration<double, std::nano>(t[s + 1] - t[s]).count());
+        }
+        total.push_back(std::chrono::duration<double, std::nano>(t[stageCount] - t[0]).count());
+    }
+    double elapsed = std::chrono::duration<double>(benchClock::now() - begin).count();
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::left << std::setw(12) << "stage" << std::right
+              << std::setw(14) << "mean ns/blk" << std::setw(14) << "p50 ns" << std::setw(14) << "p99 ns" << std::endl;
+    for(auto &s : stages) {
+        double mean = 0.0;
+        for(double v : s.ns) {
+            mean += v;
+        }
+        mean /= s.ns.size();
+        std::cout << std::left << std::setw(12) << s.name << std::right
+                  << std::setw(14) << mean << std::setw(14) << percentile(s.ns, 0.5) << std::setw(14) << percentile(s.ns, 0.99) << std::endl;
+    }
+    std::cout << std::left << std::setw(12) << "block" << std::right
+              << std::setw(14) << elapsed * 1e9 / blocks << std::setw(14) << percentile(total, 0.5) << std::setw(14) << percentile(total, 0.99) << std::endl;
+
+    double throughput = blocks * N / elapsed;
+    std::cout << std::setprecision(2)
+              << "Throughput: " << throughput / 1'000'000.0 << " MS/s (" << throughput / rate << "x real time)" << std::endl
+              << "Peak RSS: " << peakRssMb() << " MB" << std::endl;
+    return 0;
+}
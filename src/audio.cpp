@@ -0,0 +1,95 @@
+#include "audio.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+audio::audio(double sampleRate, double latency) :
+    sampleRate(sampleRate),
+    ring(static_cast<size_t>(overrunHeadroom * maxLatency * sampleRate)),
+    buffering(true),
+    underruns(0),
+    overruns(0)
+{
+    setLatency(latency);
+
+    err = Pa_Initialize();
+    if (err != paNoError) {
+        throw std::runtime_error("PortAudio error: (1) " + std::string(Pa_GetErrorText(err)));
+    }
+
+    err = Pa_OpenDefaultStream(&stream,
+                               0,          // no input channels
+                               1,          // mono output
+                               paFloat32,  // 32 bit floating point output
+                               sampleRate, // sample rate
+                               256,        // frames per buffer
+                               &audio::callback,
+                               this);
+    if (err != paNoError) {
+        Pa_Terminate();
+        throw std::runtime_error("PortAudio error: (2) " + std::string(Pa_GetErrorText(err)));
+    }
+
+    err = Pa_StartStream(stream);
+    if (err != paNoError) {
+        Pa_CloseStream(stream);
+        Pa_Terminate();
+        throw std::runtime_error("PortAudio error: (3) " + std::string(Pa_GetErrorText(err)));
+    }
+}
+
+audio::~audio()
+{
+    Pa_StopStream(stream);
+    Pa_CloseStream(stream);
+    Pa_Terminate();
+}
+
+void audio::setLatency(double seconds)
+{
+    seconds = std::clamp(seconds, 0.01, maxLatency);
+    latency = seconds;
+    targetFill = static_cast<size_t>(seconds * sampleRate);
+}
+
+double audio::getBufferedLatency()
+{
+    return static_cast<double>(ring.size()) / sampleRate;
+}
+
+void audio::write(const float *samples, size_t count)
+{
+    // Running ahead of the sound card by more than the headroom over the
+    // target latency, drop the block to pull the latency back:
+    if(ring.size() > static_cast<size_t>(overrunHeadroom * targetFill) || ring.push(samples, count) < count) {
+        overruns++;
+    }
+}
+
+int audio::callback(const void * /*input*/, void *output, unsigned long frames,
+                    const PaStreamCallbackTimeInfo * /*timeInfo*/,
+                    PaStreamCallbackFlags /*statusFlags*/, void *userData)
+{
+    static_cast<audio*>(userData)->fill(static_cast<float*>(output), frames);
+    return paContinue;
+}
+
+// Runs on the PortAudio thread, must neither lock nor allocate
+void audio::fill(float *output, unsigned long frames)
+{
+    if(buffering) {
+        if(ring.size() < targetFill) {
+            std::fill(output, output + frames, 0.0f);
+            return;
+        }
+        buffering = false;
+    }
+
+    size_t count = ring.pop(output, frames);
+    if(count < frames) {
+        // Ran dry, pad with silence and rebuffer up to the target latency:
+        std::fill(output + count, output + frames, 0.0f);
+        underruns++;
+        buffering = true;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <portaudio.h>
+#include "ringbuffer.h"
+
+// Audio output in PortAudio callback mode. The demodulator write()s into a
+// lock-free ring, the callback drains it on PortAudio's own thread, so
+// neither side ever blocks the other (or the GUI). The ring absorbs the
+// jitter of the producer: playback (re)starts only once the target latency
+// is buffered, and if the producer runs ahead (clock drift) blocks are
+// dropped instead of letting the latency grow.
+class audio {
+    public:
+    audio(double sampleRate = 48'000.0, double latency = 0.1);
+    ~audio();
+
+    // Producer side, called from the demodulator thread:
+    void write(const float *samples, size_t count);
+
+    void setLatency(double seconds);
+    double getLatency() { return latency; }
+    double getBufferedLatency();
+    uint64_t getUnderruns() { return underruns; }
+    uint64_t getOverruns() { return overruns; }
+
+    static constexpr double maxLatency = 0.5; // s
+    // Blocks are dropped once this many target latencies are queued, the
+    // slack absorbs the bursty demodulator output without dropping:
+    static constexpr double overrunHeadroom = 2.0;
+
+    private:
+    static int callback(const void *input, void *output, unsigned long frames,
+                        const PaStreamCallbackTimeInfo *timeInfo,
+                        PaStreamCallbackFlags statusFlags, void *userData);
+    void fill(float *output, unsigned long frames);
+
+    PaError err;
+    PaStream *stream;
+    double sampleRate;
+    std::atomic<double> latency;
+    std::atomic<size_t> targetFill;
+    ringBuffer<float> ring;
+
+    // Only touched by the callback:
+    bool buffering;
+
+    std::atomic<uint64_t> underruns;
+    std::atomic<uint64_t> overruns;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "averager.h"
+#include <algorithm>
+
+spectrumAverager::spectrumAverager(uint64_t N, mode m, unsigned depth) : N(N), m(m), depth(std::max(depth, 1u)), decay(0.1f)
+{
+    average.resize(N);
+    sum.resize(N);
+    reset();
+}
+
+void spectrumAverager::resize(uint64_t N)
+{
+    if(N != this->N) {
+        this->N = N;
+        average.assign(N, 0.0f);
+        sum.assign(N, 0.0);
+        reset();
+    }
+}
+
+void spectrumAverager::setMode(mode m)
+{
+    if(m != this->m) {
+        this->m = m;
+        reset();
+    }
+}
+
+void spectrumAverager::setDepth(unsigned depth)
+{
+    depth = std::max(depth, 1u);
+    if(depth != this->depth) {
+        this->depth = depth;
+        reset();
+    }
+}
+
+void spectrumAverager::reset()
+{
+    // The history is only needed (and allocated) for the boxcar mode:
+    if(m == BOXCAR) {
+        history.assign(static_cast<size_t>(depth) * N, 0.0f);
+    } else {
+        history.clear();
+        history.shrink_to_fit();
+    }
+    std::fill(sum.begin(), sum.end(), 0.0);
+    historyIndex = 0;
+    filled = 0;
+}
+
+void spectrumAverager::add(const float *spectrum)
+{
+    generation++;
+
+    // The first spectrum initializes every mode:
+    if(filled == 0 && m != BOXCAR) {
+        std::copy(spectrum, spectrum + N, average.begin());
+        filled = 1;
+        return;
+    }
+
+    switch(m) {
+        case BOXCAR: {
+            // Subtract the oldest row, add the newest one:
+            float *row = history.data() + static_cast<size_t>(historyIndex) * N;
+            for(uint64_t n = 0; n < N; n++) {
+                sum[n] += static_cast<double>(spectrum[n]) - static_cast<double>(row[n]);
+                row[n] = spectrum[n];
+            }
+            historyIndex = (historyIndex + 1) % depth;
+            filled = std::min(filled + 1, depth);
+
+            float scale = 1.0f / static_cast<float>(filled);
+            for(uint64_t n = 0; n < N; n++) {
+                average[n] = static_cast<float>(sum[n]) * scale;
+            }
+            break;
+        }
+        case EXPONENTIAL: {
+            float alpha = 1.0f / static_cast<float>(depth);
+            for(uint64_t n = 0; n < N; n++) {
+                average[n] += alpha * (spectrum[n] - average[n]);
+            }
+            break;
+        }
+        case PEAK_HOLD:
+            for(uint64_t n = 0; n < N; n++) {
+                average[n] = std::max(spectrum[n], average[n] - decay);
+            }
+            break;
+        case MIN_HOLD:
+            for(uint64_t n = 0; n < N; n++) {
+                average[n] = std::min(spectrum[n], average[n] + decay);
+            }
+            break;
+    }
+}
+
+const char* spectrumAverager::name(mode m)
+{
+    switch(m) {
+        case BOXCAR: return "Boxcar";
+        case EXPONENTIAL: return "Exponential";
+        case PEAK_HOLD: return "Peak Hold";
+        case MIN_HOLD: return "Min Hold";
+    }
+    return "";
+}
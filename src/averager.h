@@ -0,0 +1,51 @@
+#ifndef AVERAGER_H
+#define AVERAGER_H
+
+#include <cstdint>
+#include <vector>
+
+// Averages consecutive dB spectra. Every mode costs O(N) per added
+// spectrum, independent of the depth:
+//   BOXCAR      mean over the last `depth` spectra (running sum)
+//   EXPONENTIAL avg += (x - avg) / depth
+//   PEAK_HOLD   max(x, hold - decay)
+//   MIN_HOLD    min(x, hold + decay), for noise floor viewing
+class spectrumAverager {
+    public:
+    enum mode { BOXCAR, EXPONENTIAL, PEAK_HOLD, MIN_HOLD };
+
+    spectrumAverager(uint64_t N = 4096, mode m = BOXCAR, unsigned depth = 100);
+    void resize(uint64_t N);
+    void setMode(mode m);
+    void setDepth(unsigned depth);
+    void setDecay(float decay) { this->decay = decay; }
+    void reset();
+    void add(const float *spectrum);
+
+    mode getMode() { return m; }
+    unsigned getDepth() { return depth; }
+    float getDecay() { return decay; }
+    const float* getAverage() { return average.data(); }
+
+    // Incremented with every added spectrum, lets consumers skip unchanged data:
+    uint64_t getGeneration() { return generation; }
+
+    static const char* name(mode m);
+    static constexpr int count = 4;
+
+    private:
+    uint64_t N;
+    mode m;
+    unsigned depth;
+    float decay; // dB per added spectrum (hold modes)
+    std::vector<float> average;
+    uint64_t generation = 0;
+
+    // Boxcar state:
+    std::vector<float> history; // depth rows of N bins
+    std::vector<double> sum;
+    unsigned historyIndex;
+    unsigned filled;
+};
+
+#endif
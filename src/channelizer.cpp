@@ -0,0 +1,141 @@
+#include "channelizer.h"
+#include <algorithm>
+#include <cmath>
+
+channelizer::channelizer(double sampleRate, uint64_t N, unsigned int channels) :
+    in(N),
+    sampleRate(sampleRate),
+    channels(channels),
+    stagedCount(0),
+    nextId(0),
+    correction(0.0)
+{
+    bank = firpfbch2_crcf_create_kaiser(LIQUID_ANALYZER, channels, 4, 60.0f);
+
+    // Hops are processed in pairs, so every VFO sees an even number of
+    // channel samples and its decimate by two stays in step:
+    staged.resize(N + channels);
+    frames.resize((staged.size() / channels * 2) * channels);
+    out.resize(static_cast<size_t>((staged.size() / channels + 1) * ssb::audioRate / (sampleRate / channels)));
+}
+
+channelizer::~channelizer()
+{
+    firpfbch2_crcf_destroy(bank);
+}
+
+int channelizer::addVfo(double frequency, ssb::sideband side)
+{
+    std::lock_guard<std::mutex> lock(vfoMutex);
+    vfo v;
+    v.id = nextId++;
+    v.frequency = frequency;
+    v.monitored = true;
+    v.demod = std::make_unique<ssb>(getChannelRate(), frames.size() / channels);
+    v.demod->setSideband(side);
+    vfos.push_back(std::move(v));
+    return vfos.back().id;
+}
+
+void channelizer::removeVfo(int id)
+{
+    std::lock_guard<std::mutex> lock(vfoMutex);
+    vfos.erase(std::remove_if(vfos.begin(), vfos.end(), [id](const vfo &v) { return v.id == id; }), vfos.end());
+}
+
+channelizer::vfo* channelizer::find(int id)
+{
+    for(auto &v : vfos) {
+        if(v.id == id) {
+            return &v;
+        }
+    }
+    return nullptr;
+}
+
+void channelizer::setFrequency(int id, double frequency)
+{
+    std::lock_guard<std::mutex> lock(vfoMutex);
+    if(vfo *v = find(id)) {
+        v->frequency = frequency;
+    }
+}
+
+void channelizer::setSideband(int id, ssb::sideband side)
+{
+    std::lock_guard<std::mutex> lock(vfoMutex);
+    if(vfo *v = find(id)) {
+        v->demod->setSideband(side);
+    }
+}
+
+void channelizer::setMonitored(int id, bool monitored)
+{
+    std::lock_guard<std::mutex> lock(vfoMutex);
+    if(vfo *v = find(id)) {
+        v->monitored = monitored;
+    }
+}
+
+void channelizer::setSink(int id, sink s)
+{
+    std::lock_guard<std::mutex> lock(vfoMutex);
+    if(vfo *v = find(id)) {
+        v->output = s;
+    }
+}
+
+std::vector<channelizer::vfoInfo> channelizer::getVfos()
+{
+    std::lock_guard<std::mutex> lock(vfoMutex);
+    std::vector<vfoInfo> info;
+    for(auto &v : vfos) {
+        info.push_back({v.id, v.frequency, v.demod->getSideband(), v.monitored});
+    }
+    return info;
+}
+
+unsigned int channelizer::process(uint64_t count)
+{
+    // Analysis filterbank, one hop consumes channels/2 input samples and
+    // yields one sample per channel:
+    std::copy(in.begin(), in.begin() + count, staged.begin() + stagedCount);
+    stagedCount += count;
+    size_t hop = channels / 2;
+    size_t hops = stagedCount / channels * 2;
+    for(size_t h = 0; h < hops; h++) {
+        firpfbch2_crcf_execute(bank, &staged[h * hop], &frames[h * channels]);
+    }
+    std::copy(staged.begin() + hops * hop, staged.begin() + stagedCount, staged.begin());
+    stagedCount -= hops * hop;
+
+    std::lock_guard<std::mutex> lock(vfoMutex);
+    unsigned int produced = 0;
+    std::fill(out.begin(), out.end(), 0.0f);
+    double shift = correction;
+    for(auto &v : vfos) {
+        // Channel closest to the center of the passband, the remainder is
+        // tuned by the demodulator at the channel rate:
+        double pitch = (ssb::lowCut + ssb::highCut) / 2.0;
+        double frequency = v.frequency + shift;
+        double center = v.demod->getSideband() == ssb::USB ? frequency + pitch : frequency - pitch;
+        int k = static_cast<int>(std::lround(center / getChannelSpacing()));
+        double residual = frequency - k * getChannelSpacing();
+        unsigned int channel = static_cast<unsigned int>((k % static_cast<int>(channels) + channels) % channels);
+
+        for(size_t h = 0; h < hops; h++) {
+            v.demod->in[h] = frames[h * channels + channel];
+        }
+        unsigned int n = v.demod->demodulate(residual, hops);
+        if(v.output) {
+            v.output(v.demod->out.data(), n);
+        }
+        if(v.monitored) {
+            for(unsigned int i = 0; i < n; i++) {
+                out[i] += v.demod->out[i];
+            }
+        }
+        produced = std::max(produced, n);
+    }
+    return produced;
+}
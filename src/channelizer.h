@@ -0,0 +1,84 @@
+#ifndef CHANNELIZER_H
+#define CHANNELIZER_H
+
+#include <atomic>
+#include <complex>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <liquid.h>
+#include "dsp.h"
+
+// Multi VFO receiver. A 2x oversampled polyphase filterbank splits the
+// whole band into fixed width channels in one pass (one small FFT per
+// M/2 input samples, independent of the number of VFOs). Every VFO picks
+// the channel closest to its passband and demodulates it at the channel
+// rate with its own ssb receiver, so a VFO costs a few MACs per channel
+// sample instead of a full rate mixer and decimator.
+class channelizer {
+    public:
+    typedef std::function<void(const float*, size_t)> sink;
+
+    channelizer(double sampleRate = 576'000.0, uint64_t N = 4096, unsigned int channels = 48);
+    ~channelizer();
+
+    // VFO frequencies are offsets from the band center in Hz:
+    int addVfo(double frequency, ssb::sideband side = ssb::USB);
+    void removeVfo(int id);
+    void setFrequency(int id, double frequency);
+    void setSideband(int id, ssb::sideband side);
+    void setMonitored(int id, bool monitored);
+    // Added to every VFO frequency (drift correction), in Hz:
+    void setCorrection(double offset) { correction = offset; }
+    // Every VFO can feed its own sink (e.g. a recorder) with its audio. The
+    // sink runs on the audio thread, once this returns the old one is no
+    // longer called:
+    void setSink(int id, sink s);
+
+    struct vfoInfo {
+        int id;
+        double frequency;
+        ssb::sideband side;
+        bool monitored;
+    };
+    std::vector<vfoInfo> getVfos();
+
+    // Channelizes `count` samples of `in` and runs every VFO, the monitored
+    // ones are mixed into `out`. Returns the number of audio samples.
+    unsigned int process(uint64_t count);
+
+    double getChannelSpacing() { return sampleRate / channels; }
+    double getChannelRate() { return 2.0 * sampleRate / channels; }
+    unsigned int getChannels() { return channels; }
+
+    std::vector<std::complex<float>> in;
+    std::vector<float> out;
+
+    private:
+    struct vfo {
+        int id;
+        double frequency;
+        bool monitored;
+        std::unique_ptr<ssb> demod;
+        sink output;
+    };
+    vfo* find(int id);
+
+    double sampleRate;
+    unsigned int channels;
+    firpfbch2_crcf bank;
+
+    // Input waiting for complete filterbank hops, and the filterbank
+    // output (frame major, one row of `channels` samples per hop):
+    std::vector<std::complex<float>> staged;
+    size_t stagedCount;
+    std::vector<std::complex<float>> frames;
+
+    std::mutex vfoMutex;
+    std::vector<vfo> vfos;
+    int nextId;
+    std::atomic<double> correction;
+};
+
+#endif
@@ -0,0 +1,221 @@
+#include "detector.h"
+#include <algorithm>
+#include <cmath>
+
+signalDetector::signalDetector(frequencyPlan *plan, uint64_t N) :
+    plan(plan),
+    N(0),
+    threshold(10.0f),
+    time(0.0),
+    frame(0),
+    nextId(0),
+    peaks(maxPeaks),
+    peakCount(0),
+    tracks(maxTracks),
+    lastSeen(maxTracks, 0),
+    history(historySize),
+    historyIndex(0),
+    historyCount(0)
+{
+    resize(N);
+}
+
+void signalDetector::resize(uint64_t N)
+{
+    if(N == this->N) {
+        return;
+    }
+    this->N = N;
+    scratch.resize(blockSize);
+    blockFloor.assign((N + blockSize - 1) / blockSize, 0.0f);
+    floor.assign(N, 0.0f);
+    floorValid = false;
+
+    // Bins moved, running signals are ended:
+    for(auto &s : tracks) {
+        if(s.active) {
+            end(s);
+        }
+    }
+}
+
+void signalDetector::addSegment(double start, double end, const char *label)
+{
+    segments.push_back({start, end, label, 0, 0, 0, 0.0f, -1.0});
+}
+
+void signalDetector::resetStatistics()
+{
+    for(auto &s : segments) {
+        s.frames = 0;
+        s.occupiedBins = 0;
+        s.totalBins = 0;
+        s.current = 0.0f;
+        s.lastActivity = -1.0;
+    }
+    historyCount = 0;
+}
+
+void signalDetector::process(const float *spectrum)
+{
+    estimateFloor(spectrum);
+    findPeaks(spectrum);
+    track();
+    frame++;
+    time += static_cast<double>(N) / plan->getSampleRate();
+}
+
+// Low percentile per block, follows slow changes of the floor only
+void signalDetector::estimateFloor(const float *spectrum)
+{
+    const float alpha = 0.05f;
+    for(size_t b = 0; b < blockFloor.size(); b++) {
+        size_t first = b * blockSize;
+        size_t count = std::min<size_t>(blockSize, N - first);
+        std::copy(spectrum + first, spectrum + first + count, scratch.begin());
+        auto nth = scratch.begin() + count / 4;
+        std::nth_element(scratch.begin(), nth, scratch.begin() + count);
+        blockFloor[b] = floorValid ? blockFloor[b] + alpha * (*nth - blockFloor[b]) : *nth;
+    }
+    floorValid = true;
+
+    // Interpolate between the block centers:
+    double center = blockSize / 2.0;
+    for(uint64_t n = 0; n < N; n++) {
+        double position = std::clamp((n - center) / blockSize, 0.0, static_cast<double>(blockFloor.size() - 1));
+        size_t b = static_cast<size_t>(position);
+        size_t next = std::min(b + 1, blockFloor.size() - 1);
+        float fraction = static_cast<float>(position - b);
+        floor[n] = blockFloor[b] + fraction * (blockFloor[next] - blockFloor[b]);
+    }
+}
+
+void signalDetector::findPeaks(const float *spectrum)
+{
+    peakCount = 0;
+    for(uint64_t n = 1; n + 1 < N && peakCount < maxPeaks; n++) {
+        if(spectrum[n] - floor[n] <= threshold) {
+            continue;
+        }
+        if(spectrum[n] < spectrum[n - 1] || spectrum[n] <= spectrum[n + 1]) {
+            continue;
+        }
+
+        // Parabola through the peak and its neighbours:
+        float a = spectrum[n - 1];
+        float b = spectrum[n];
+        float c = spectrum[n + 1];
+        float denominator = a - 2.0f * b + c;
+        float delta = denominator < 0.0f ? 0.5f * (a - c) / denominator : 0.0f;
+        float level = b - 0.25f * (a - c) * delta;
+        peaks[peakCount++] = {static_cast<double>(n) + delta, level, level - floor[n]};
+    }
+
+    // Occupancy, every bin above the threshold counts:
+    for(auto &s : segments) {
+        double first = std::max(0.0, std::ceil(plan->frequencyToBucket(s.start)));
+        double last = std::min(static_cast<double>(N), std::ceil(plan->frequencyToBucket(s.end)));
+        uint64_t occupied = 0;
+        uint64_t bins = 0;
+        for(uint64_t n = static_cast<uint64_t>(first); n < static_cast<uint64_t>(std::max(first, last)); n++) {
+            occupied += spectrum[n] - floor[n] > threshold;
+            bins++;
+        }
+        s.frames++;
+        s.occupiedBins += occupied;
+        s.totalBins += bins;
+        s.current = bins ? static_cast<float>(occupied) / bins : 0.0f;
+    }
+}
+
+void signalDetector::track()
+{
+    // A peak continues the closest active track within the tolerance.
+    // Candidates have to be hit in consecutive frames to be confirmed, a
+    // confirmed signal may fade for a few frames:
+    double tolerance = std::max(2.0, 500.0 / plan->getBinWidth());
+
+    // Strong peaks claim their tracks first:
+    std::sort(peaks.begin(), peaks.begin() + peakCount, [](const peak &a, const peak &b) { return a.snr > b.snr; });
+    for(size_t p = 0; p < peakCount; p++) {
+        const peak &pk = peaks[p];
+        signal *best = nullptr;
+        double bestDistance = tolerance;
+        signal *free = nullptr;
+        for(size_t t = 0; t < maxTracks; t++) {
+            signal &s = tracks[t];
+            if(!s.active) {
+                if(free == nullptr) {
+                    free = &s;
+                }
+                continue;
+            }
+            double distance = std::abs(s.bin - pk.bin);
+            if(!s.confirmed) {
+                distance *= 2.0;
+            }
+            if(distance < bestDistance && lastSeen[t] != frame) {
+                best = &s;
+                bestDistance = distance;
+            }
+        }
+
+        if(best == nullptr) {
+            if(free == nullptr) {
+                continue;
+            }
+            best = free;
+            *best = signal{nextId++, 0.0, pk.bin, pk.level, pk.snr, pk.snr, time, time, 0, -1, true, false};
+        }
+
+        size_t t = static_cast<size_t>(best - tracks.data());
+        lastSeen[t] = frame;
+        best->bin += 0.2 * (pk.bin - best->bin);
+        best->frequency = plan->bucketToFrequency(best->bin);
+        best->level = pk.level;
+        best->snr = pk.snr;
+        best->peakSnr = std::max(best->peakSnr, pk.snr);
+        best->stop = time;
+        best->hits++;
+        best->segment = findSegment(best->frequency);
+
+        if(!best->confirmed && best->hits >= minHits) {
+            best->confirmed = true;
+            if(best->segment >= 0) {
+                segments[best->segment].lastActivity = time;
+            }
+            if(activity) {
+                activity(*best);
+            }
+        }
+    }
+
+    // Tracks without a peak for a while have ended:
+    for(size_t t = 0; t < maxTracks; t++) {
+        uint64_t hold = tracks[t].confirmed ? holdFrames : 0;
+        if(tracks[t].active && frame - lastSeen[t] > hold) {
+            end(tracks[t]);
+        }
+    }
+}
+
+void signalDetector::end(signal &s)
+{
+    s.active = false;
+    if(!s.confirmed) {
+        return;
+    }
+    history[historyIndex] = s;
+    historyIndex = (historyIndex + 1) % history.size();
+    historyCount = std::min(historyCount + 1, history.size());
+}
+
+int signalDetector::findSegment(double frequency)
+{
+    for(size_t i = 0; i < segments.size(); i++) {
+        if(frequency >= segments[i].start && frequency < segments[i].end) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
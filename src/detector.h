@@ -0,0 +1,114 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "frequencyplan.h"
+
+// Streaming signal detector, fed with every FFT frame. The noise floor is
+// a running low percentile per block of bins (smoothed over time and
+// interpolated between blocks), peaks above floor + threshold are located
+// with parabolic sub-bin interpolation and tracked as persistent signals
+// with start/stop time and SNR. Per bandplan segment the share of occupied
+// bins is counted. All buffers are sized on construction / resize(), a
+// frame does not allocate.
+class signalDetector {
+    public:
+    struct signal {
+        uint32_t id;
+        double frequency; // Hz
+        double bin;
+        float level; // dBFS
+        float snr; // dB
+        float peakSnr; // dB
+        double start; // s (sample time)
+        double stop; // s, last time seen while active
+        uint32_t hits;
+        int segment; // -1 outside the bandplan
+        bool active;
+        bool confirmed;
+    };
+
+    struct segment {
+        double start; // Hz
+        double end; // Hz
+        std::string label;
+        uint64_t frames;
+        uint64_t occupiedBins;
+        uint64_t totalBins;
+        float current; // Occupancy of the last frame [0, 1]
+        double lastActivity; // s, -1 if never active
+        double getOccupancy() const { return totalBins ? static_cast<double>(occupiedBins) / totalBins : 0.0; }
+    };
+
+    signalDetector(frequencyPlan *plan, uint64_t N = 4096);
+    void resize(uint64_t N);
+    void addSegment(double start, double end, const char *label);
+    void resetStatistics();
+
+    void process(const float *spectrum);
+
+    void setThreshold(float dB) { threshold = dB; }
+    float getThreshold() { return threshold; }
+
+    // Called once per signal when it is confirmed (seen in minHits
+    // consecutive frames):
+    void setActivityCallback(std::function<void(const signal&)> callback) { activity = callback; }
+
+    // Track slots, only entries with `active` set are current signals:
+    const std::vector<signal>& getSignals() { return tracks; }
+    // Ended signals, newest first:
+    size_t getHistoryCount() { return historyCount; }
+    const signal& getHistory(size_t i) { return history[(historyIndex + history.size() - 1 - i) % history.size()]; }
+    const std::vector<segment>& getSegments() { return segments; }
+    const float* getNoiseFloor() { return floor.data(); }
+    double getTime() { return time; }
+
+    static constexpr size_t blockSize = 64; // Bins per noise floor block
+    static constexpr size_t maxPeaks = 256;
+    static constexpr size_t maxTracks = 128;
+    static constexpr size_t historySize = 256;
+    static constexpr uint32_t minHits = 3;
+    static constexpr uint32_t holdFrames = 10;
+
+    private:
+    void estimateFloor(const float *spectrum);
+    void findPeaks(const float *spectrum);
+    void track();
+    void end(signal &s);
+    int findSegment(double frequency);
+
+    frequencyPlan *plan;
+    uint64_t N;
+    float threshold;
+    double time;
+    uint64_t frame;
+    uint32_t nextId;
+
+    // Noise floor:
+    std::vector<float> scratch;
+    std::vector<float> blockFloor;
+    std::vector<float> floor;
+    bool floorValid;
+
+    struct peak {
+        double bin;
+        float level;
+        float snr;
+    };
+    std::vector<peak> peaks;
+    size_t peakCount;
+
+    std::vector<signal> tracks;
+    std::vector<uint64_t> lastSeen;
+    std::vector<signal> history;
+    size_t historyIndex;
+    size_t historyCount;
+
+    std::vector<segment> segments;
+    std::function<void(const signal&)> activity;
+};
+
+#endif
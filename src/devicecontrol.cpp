@@ -0,0 +1,307 @@
+#include "devicecontrol.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+void retuneRequest::merge(const retuneRequest &later)
+{
+    if(later.rxFrequency) {
+        rxFrequency = later.rxFrequency;
+    }
+    if(later.txFrequency) {
+        txFrequency = later.txFrequency;
+    }
+    if(later.rxBandwidth) {
+        rxBandwidth = later.rxBandwidth;
+    }
+    if(later.txBandwidth) {
+        txBandwidth = later.txBandwidth;
+    }
+    if(later.txGain) {
+        txGain = later.txGain;
+    }
+}
+
+deviceControl::deviceControl() :
+    phy(nullptr),
+    rxLo(nullptr),
+    txLo(nullptr),
+    rxPhy(nullptr),
+    txPhy(nullptr),
+    fastlock(false),
+    running(false),
+    retunes(0),
+    batched(0),
+    lastLoWrite(0.0),
+    maxLoWrite(0.0)
+{
+    metrics &registry = metrics::instance();
+    registry.addProbe(this, "retunes", "Retunes executed", [this]() { return retunes.load(); });
+    registry.addProbe(this, "retune_batched_requests", "Queued retunes merged into a later one", [this]() { return batched.load(); });
+    registry.addProbe(this, "retune_lo_write_seconds", "LO write latency of the last retune", [this]() { return lastLoWrite.load(); });
+    registry.addProbe(this, "retune_lo_write_max_seconds", "Longest LO write latency", [this]() { return maxLoWrite.load(); });
+}
+
+deviceControl::~deviceControl()
+{
+    metrics::instance().removeProbes(this);
+    close();
+}
+
+bool deviceControl::open(iio_context *context)
+{
+    close();
+
+    iio_device *device = iio_context_find_device(context, "ad9361-phy");
+    if(device == nullptr) {
+        std::cout << "ERROR: Cannot find the ad9361-phy device" << std::endl;
+        return false;
+    }
+    iio_channel *rxLoChannel = iio_device_find_channel(device, "altvoltage0", true);
+    iio_channel *txLoChannel = iio_device_find_channel(device, "altvoltage1", true);
+    iio_channel *rxPhyChannel = iio_device_find_channel(device, "voltage0", false);
+    iio_channel *txPhyChannel = iio_device_find_channel(device, "voltage0", true);
+    if(rxLoChannel == nullptr || txLoChannel == nullptr || rxPhyChannel == nullptr || txPhyChannel == nullptr) {
+        std::cout << "ERROR: Cannot find the ad9361-phy LO and phy channels" << std::endl;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        rxLo = rxLoChannel;
+        txLo = txLoChannel;
+        rxPhy = rxPhyChannel;
+        txPhy = txPhyChannel;
+        rxProfiles = profiles();
+        txProfiles = profiles();
+        phy = device;
+    }
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    running = true;
+    worker = std::thread(&deviceControl::run, this);
+    return true;
+}
+
+void deviceControl::close()
+{
+    std::deque<command> dropped;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        running = false;
+    }
+    queueChanged.notify_all();
+    if(worker.joinable()) {
+        worker.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        dropped.swap(queue);
+    }
+
+    // The synchronous calls check isOpen() under the same lock, so none
+    // writes through a channel cleared here:
+    {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        phy = nullptr;
+        rxLo = nullptr;
+        txLo = nullptr;
+        rxPhy = nullptr;
+        txPhy = nullptr;
+    }
+
+    // Requests still queued never ran:
+    for(auto &c : dropped) {
+        if(c.done) {
+            c.done(retuneResult());
+        }
+    }
+}
+
+bool deviceControl::configureRx(int64_t bandwidth, int64_t sampleRate, const std::string &port, const std::string &gainMode)
+{
+    std::lock_guard<std::mutex> lock(ioMutex);
+    if(!isOpen()) {
+        return false;
+    }
+    bool ok = write(rxPhy, "rf_port_select", port.c_str());
+    ok &= write(rxPhy, "rf_bandwidth", bandwidth);
+    ok &= write(rxPhy, "sampling_frequency", sampleRate);
+    ok &= write(rxPhy, "gain_control_mode", gainMode.c_str());
+    return ok;
+}
+
+bool deviceControl::configureTx(int64_t bandwidth, int64_t sampleRate, const std::string &port)
+{
+    std::lock_guard<std::mutex> lock(ioMutex);
+    if(!isOpen()) {
+        return false;
+    }
+    bool ok = write(txPhy, "rf_port_select", port.c_str());
+    ok &= write(txPhy, "rf_bandwidth", bandwidth);
+    ok &= write(txPhy, "sampling_frequency", sampleRate);
+    return ok;
+}
+
+bool deviceControl::setTxGain(double dB)
+{
+    std::lock_guard<std::mutex> lock(ioMutex);
+    if(!isOpen()) {
+        return false;
+    }
+    return write(txPhy, "hardwaregain", dB);
+}
+
+retuneResult deviceControl::retune(const retuneRequest &request)
+{
+    std::lock_guard<std::mutex> lock(ioMutex);
+    if(!isOpen()) {
+        return retuneResult();
+    }
+    return execute(request);
+}
+
+void deviceControl::post(const retuneRequest &request, callback done)
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if(running) {
+            queue.push_back({request, done});
+            queueChanged.notify_one();
+            return;
+        }
+    }
+    // Closed, there is no worker to run it:
+    if(done) {
+        done(retuneResult());
+    }
+}
+
+// Takes everything queued at once, merges it into one request and reports
+// the single result to every caller
+void deviceControl::run()
+{
+    while(true) {
+        std::deque<command> pending;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this]() { return !running || !queue.empty(); });
+            if(!running) {
+                return;
+            }
+            pending.swap(queue);
+        }
+
+        retuneRequest merged;
+        for(auto &c : pending) {
+            merged.merge(c.request);
+        }
+        batched += pending.size() - 1;
+
+        retuneResult result;
+        {
+            std::lock_guard<std::mutex> lock(ioMutex);
+            result = execute(merged);
+        }
+        result.requests = static_cast<unsigned>(pending.size());
+        for(auto &c : pending) {
+            if(c.done) {
+                c.done(result);
+            }
+        }
+    }
+}
+
+// Filters and gain first, the LOs last, so the signal shows up at the new
+// frequency with the new settings. Called with ioMutex held.
+retuneResult deviceControl::execute(const retuneRequest &request)
+{
+    static histogram &retuneTime = metrics::instance().getHistogram("retune", "Attribute writes of one retune");
+    scopedTimer timer(retuneTime);
+
+    retuneResult result;
+    result.ok = true;
+    auto start = std::chrono::steady_clock::now();
+
+    if(request.rxBandwidth) {
+        result.ok &= write(rxPhy, "rf_bandwidth", *request.rxBandwidth);
+    }
+    if(request.txBandwidth) {
+        result.ok &= write(txPhy, "rf_bandwidth", *request.txBandwidth);
+    }
+    if(request.txGain) {
+        result.ok &= write(txPhy, "hardwaregain", *request.txGain);
+    }
+
+    // The LO write returns once the synthesizer calibrated (or recalled a
+    // profile), the read back confirms it took the new frequency:
+    auto loStart = std::chrono::steady_clock::now();
+    if(request.rxFrequency) {
+        result.ok &= tuneLo(rxLo, rxProfiles, *request.rxFrequency, result.rxFrequency);
+    }
+    if(request.txFrequency) {
+        result.ok &= tuneLo(txLo, txProfiles, *request.txFrequency, result.txFrequency);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    result.writeTime = std::chrono::duration<double>(end - start).count();
+    if(request.rxFrequency || request.txFrequency) {
+        result.loWriteTime = std::chrono::duration<double>(end - loStart).count();
+        lastLoWrite = result.loWriteTime;
+        maxLoWrite = std::max(maxLoWrite.load(), result.loWriteTime);
+    }
+    retunes++;
+    if(!result.ok) {
+        std::cout << "ERROR: Retune failed" << std::endl;
+    }
+    return result;
+}
+
+bool deviceControl::tuneLo(iio_channel *lo, profiles &stored, int64_t frequency, int64_t &readBack)
+{
+    bool ok;
+    auto slot = stored.slots.find(frequency);
+    if(fastlock && slot != stored.slots.end()) {
+        ok = write(lo, "fastlock_recall", static_cast<int64_t>(slot->second));
+        stored.order.erase(std::find(stored.order.begin(), stored.order.end(), frequency));
+        stored.order.push_back(frequency);
+    } else {
+        ok = write(lo, "frequency", frequency);
+        if(ok && fastlock) {
+            // Store the fresh calibration, in the least recently used slot
+            // once all are taken:
+            bool full = stored.slots.size() >= fastlockProfiles;
+            unsigned int free = full ? stored.slots[stored.order.front()] : static_cast<unsigned int>(stored.slots.size());
+            if(write(lo, "fastlock_store", static_cast<int64_t>(free))) {
+                if(full) {
+                    stored.slots.erase(stored.order.front());
+                    stored.order.pop_front();
+                }
+                stored.slots[frequency] = free;
+                stored.order.push_back(frequency);
+            }
+        }
+    }
+
+    long long value = 0;
+    if(iio_channel_attr_read_longlong(lo, "frequency", &value) < 0) {
+        return false;
+    }
+    readBack = value;
+    return ok;
+}
+
+bool deviceControl::write(iio_channel *channel, const char *attribute, const char *value)
+{
+    return iio_channel_attr_write(channel, attribute, value) >= 0;
+}
+
+bool deviceControl::write(iio_channel *channel, const char *attribute, int64_t value)
+{
+    return iio_channel_attr_write_longlong(channel, attribute, value) >= 0;
+}
+
+bool deviceControl::write(iio_channel *channel, const char *attribute, double value)
+{
+    return iio_channel_attr_write_double(channel, attribute, value) >= 0;
+}
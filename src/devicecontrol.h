@@ -0,0 +1,126 @@
+#ifndef DEVICECONTROL_H
+#define DEVICECONTROL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <iio.h>
+
+// Settings of one retune, fields left empty are not written:
+struct retuneRequest {
+    std::optional<int64_t> rxFrequency; // LO in Hz
+    std::optional<int64_t> txFrequency;
+    std::optional<int64_t> rxBandwidth;
+    std::optional<int64_t> txBandwidth;
+    std::optional<double> txGain; // dB
+
+    // Fields set in `later` win:
+    void merge(const retuneRequest &later);
+};
+
+struct retuneResult {
+    bool ok = false;
+    unsigned requests = 0; // Queued requests batched into this retune
+    double writeTime = 0.0; // s for all attribute writes
+    // s from the first LO write until its read back. The driver returns once
+    // the VCO is calibrated, so this is write latency, not a PLL lock time:
+    double loWriteTime = 0.0;
+    int64_t rxFrequency = 0; // LO as read back, 0 if not retuned
+    int64_t txFrequency = 0;
+};
+
+// AD9361 control path. The phy device, its LO channels and the RX/TX phy
+// channels are looked up once at open(), attribute writes then go straight
+// to the cached channels. All I/O is serialized, so every method can be
+// called from any thread. post() queues a retune for the worker thread,
+// which batches everything queued meanwhile into one set of writes (a
+// scan that posts faster than the hardware retunes only pays for the
+// newest request). Optionally the LO calibrations are kept in the
+// AD9361's fastlock profiles, a hop back to a stored frequency then
+// recalls the profile instead of running the VCO calibration again.
+class deviceControl {
+    public:
+    typedef std::function<void(const retuneResult&)> callback;
+
+    deviceControl();
+    ~deviceControl();
+
+    bool open(iio_context *context);
+    void close();
+    bool isOpen() { return phy != nullptr; }
+    iio_device* getPhy() { return phy; }
+
+    // Synchronous setup at connect:
+    bool configureRx(int64_t bandwidth, int64_t sampleRate, const std::string &port, const std::string &gainMode);
+    bool configureTx(int64_t bandwidth, int64_t sampleRate, const std::string &port);
+
+    // Synchronous, for the latency critical paths (e.g. keying the TX):
+    bool setTxGain(double dB);
+    retuneResult retune(const retuneRequest &request);
+
+    // Asynchronous, `done` runs on the worker thread:
+    void post(const retuneRequest &request, callback done = nullptr);
+
+    // Recall stored LO calibrations on hops (AD9361 fastlock, 8 profiles
+    // per LO, the least recently used one is replaced):
+    void setFastlock(bool on) { fastlock = on; }
+    bool getFastlock() { return fastlock; }
+
+    uint64_t getRetunes() { return retunes; }
+    uint64_t getBatched() { return batched; }
+    double getLastLoWrite() { return lastLoWrite; } // s
+    double getMaxLoWrite() { return maxLoWrite; } // s
+
+    static constexpr unsigned int fastlockProfiles = 8;
+
+    private:
+    struct command {
+        retuneRequest request;
+        callback done;
+    };
+    // Slot per stored LO frequency, plus the order of use:
+    struct profiles {
+        std::map<int64_t, unsigned int> slots;
+        std::deque<int64_t> order;
+    };
+
+    void run();
+    retuneResult execute(const retuneRequest &request);
+    bool tuneLo(iio_channel *lo, profiles &stored, int64_t frequency, int64_t &readBack);
+    bool write(iio_channel *channel, const char *attribute, const char *value);
+    bool write(iio_channel *channel, const char *attribute, int64_t value);
+    bool write(iio_channel *channel, const char *attribute, double value);
+
+    // Cached at open():
+    std::atomic<iio_device*> phy; // Written under ioMutex
+    iio_channel *rxLo; // altvoltage0
+    iio_channel *txLo; // altvoltage1
+    iio_channel *rxPhy; // voltage0 input
+    iio_channel *txPhy; // voltage0 output
+
+    std::mutex ioMutex;
+    profiles rxProfiles;
+    profiles txProfiles;
+    std::atomic<bool> fastlock;
+
+    // Command queue:
+    std::thread worker;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<command> queue;
+    bool running;
+
+    std::atomic<uint64_t> retunes;
+    std::atomic<uint64_t> batched;
+    std::atomic<double> lastLoWrite;
+    std::atomic<double> maxLoWrite;
+};
+
+#endif
@@ -1,160 +1,354 @@
 #include "dsp.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
-fft::fft(uint64_t N) : N(N)
+template <typename T>
+fft<T>::fft(uint64_t N) : N(N), taper(N), spectrum(N)
 {
-    in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    shifted = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * N);
-    p = fftw_plan_dft_1d(N, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
+    allocate();
+    planGeneration = fftPlanner<T>::instance().getGeneration();
+    p = fftPlanner<T>::instance().getPlan(N, FFTW_FORWARD);
 }
 
-fft::~fft()
+template <typename T>
+fft<T>::~fft()
 {
-    fftw_destroy_plan(p);
-    fftw_free(in); fftw_free(out);
+    release();
 }
 
-void fft::processSamples()
+template <typename T>
+void fft<T>::allocate()
 {
-    hammingWindow();
-    fftw_execute(p);
-    shiftFft();
+    in = (complex*) fftwTraits<T>::malloc(sizeof(complex) * N);
+    out = (complex*) fftwTraits<T>::malloc(sizeof(complex) * N);
 }
 
-void fft::shiftFft()
+template <typename T>
+void fft<T>::release()
 {
-    // Perform an FFT-Shift to bring the zero frequency component to the center
-    for (uint64_t i = 0; i < N / 2; ++i) {
-        std::swap(out[i], out[i + N / 2]);
+    // The plan is shared and owned by the planner
+    fftwTraits<T>::free(in); fftwTraits<T>::free(out);
+}
+
+// Switches the transform size, keeping the selected window. Runs live on
+// the GUI thread, so it starts on an estimated plan and transform() swaps
+// in the measured one once the planner has it.
+template <typename T>
+void fft<T>::resize(uint64_t N)
+{
+    if(N == this->N) {
+        return;
     }
+    release();
+    this->N = N;
+    taper = windowFunction(N, taper.getType(), taper.getBeta());
+    spectrum.assign(N, -200.0f);
+    allocate();
+    planGeneration = fftPlanner<T>::instance().getGeneration();
+    p = fftPlanner<T>::instance().getPlanNow(N, FFTW_FORWARD);
+}
+
+template <typename T>
+void fft<T>::processSamples()
+{
+    transform();
+    powerSpectrum();
 }
 
-void fft::hammingWindow()
+template <typename T>
+void fft<T>::transform()
 {
-    // https://de.wikipedia.org/wiki/Fensterfunktion#Hamming-Fenster
-    for(uint64_t i = 0; i < N; i++) {
-        in[i][0] *= 0.54 - 0.46 * cos(2 * M_PI * i / N);
-        in[i][1] *= 0.54 - 0.46 * cos(2 * M_PI * i / N);
+    static histogram &windowTime = metrics::instance().getHistogram("window", "Window and fftshift");
+    static histogram &fftTime = metrics::instance().getHistogram("fft", "fftw_execute");
+
+    // A more rigorous plan got ready (a lookup, never plans here):
+    uint64_t generation = fftPlanner<T>::instance().getGeneration();
+    if(generation != planGeneration) {
+        planGeneration = generation;
+        p = fftPlanner<T>::instance().getPlanNow(N, FFTW_FORWARD);
     }
+
+    // The window also performs the fftshift, so the output is already centered
+    {
+        scopedTimer timer(windowTime);
+        taper.apply(in);
+    }
+    scopedTimer timer(fftTime);
+    fftwTraits<T>::execute(p, in, out);
+}
+
+template <typename T>
+void fft<T>::powerSpectrum()
+{
+    static histogram &powerTime = metrics::instance().getHistogram("power_spectrum", "Magnitude and dB conversion");
+    scopedTimer timer(powerTime);
+
+    // 20*log10(|X|/norm) == 10*log10(|X|^2) - 20*log10(norm)
+    T offset = static_cast<T>(20.0 * log10(static_cast<double>(N) * taper.getCoherentGain()));
+    for(uint64_t n = 0; n < N; n++) {
+        T power = out[n][0] * out[n][0] + out[n][1] * out[n][1] + std::numeric_limits<T>::min();
+        spectrum[n] = static_cast<float>(static_cast<T>(10.0) * std::log10(power) - offset);
+    }
+}
+
+template <typename T>
+void fft<T>::setWindow(windowFunction::type t, double beta)
+{
+    taper.setType(t, beta);
 }
 
-ssb::ssb(uint64_t N) : N(N)
+template class fft<float>;
+template class fft<double>;
+
+oscillator::oscillator() : phase(0.0), increment(0.0)
 {
-    // Mixer:
-    mixer = nco_crcf_create(LIQUID_VCO);
-    //nco_crcf_set_frequency(mixer, ); //TDOD continue heare!
+    std::fill(tableRe, tableRe + chunk, 1.0f);
+    std::fill(tableIm, tableIm + chunk, 0.0f);
+}
 
-    // Rational rate resampler with low-pass filter:
-    unsigned int sample_rate_raw = 576'000; // TODO: Get from pluto
-    unsigned int sample_rate_wav = 48'000;
-    unsigned int gcd = liquid_gcd(sample_rate_raw, sample_rate_wav);
-    Q = sample_rate_raw / gcd; // input rate
-    P = sample_rate_wav / gcd; // output rate
-    unsigned int m = 12; // filter semi-length
-    float bw = 3.0e3f / (float)sample_rate_raw; // filter bandwidth
-    float As = 40.0f; // stop-band suppression [dB]
-    buf_len = P > Q ? P : Q;
-    std::cout << "XXXXXXXX " << gcd << " " << buf_len << std::endl;
-    resamp = rresamp_crcf_create_kaiser(P,Q,m,bw,As);
-    rresamp_crcf_print(resamp);
+void oscillator::setFrequency(double frequency, double sampleRate)
+{
+    // Only retune on a change, the phase stays continuous:
+    double increment = 2.0 * M_PI * frequency / sampleRate;
+    if(increment == this->increment) {
+        return;
+    }
+    this->increment = increment;
+    for(size_t k = 0; k < chunk; k++) {
+        tableRe[k] = static_cast<float>(cos(increment * k));
+        tableIm[k] = static_cast<float>(sin(increment * k));
+    }
+}
 
-    // allocate buffers for sample processing (two each complex and real)
-    buf_0 = new std::complex<float>[buf_len];
-    buf_1 = new std::complex<float>[buf_len];
-    buf_2 = new float[buf_len];
-    out = new float[buf_len];
+void oscillator::mixDown(const std::complex<float> *in, std::complex<float> *out, size_t count)
+{
+    const float *x = reinterpret_cast<const float*>(in);
+    float *y = reinterpret_cast<float*>(out);
+    for(size_t offset = 0; offset < count; offset += chunk) {
+        size_t n = std::min(chunk, count - offset);
+        float baseRe = static_cast<float>(cos(phase));
+        float baseIm = static_cast<float>(-sin(phase));
+        for(size_t k = 0; k < n; k++) {
+            // e^(-j(phase + k*increment)):
+            float re = baseRe * tableRe[k] + baseIm * tableIm[k];
+            float im = baseIm * tableRe[k] - baseRe * tableIm[k];
+            float xr = x[2 * (offset + k)];
+            float xi = x[2 * (offset + k) + 1];
+            y[2 * (offset + k)] = xr * re - xi * im;
+            y[2 * (offset + k) + 1] = xr * im + xi * re;
+        }
+        phase = remainder(phase + n * increment, 2.0 * M_PI);
+    }
+}
 
-    // Demodulator:
-    float mod_index = 0.1f; // Modulation index (bandwidth)
-    liquid_ampmodem_type type = LIQUID_AMPMODEM_USB; 
-    int suppressed = 1; // Suppressed carrier
-    demod = ampmodem_create(mod_index, type, suppressed);
+void oscillator::mixUpReal(const std::complex<float> *in, float *out, size_t count)
+{
+    const float *x = reinterpret_cast<const float*>(in);
+    for(size_t offset = 0; offset < count; offset += chunk) {
+        size_t n = std::min(chunk, count - offset);
+        float baseRe = static_cast<float>(cos(phase));
+        float baseIm = static_cast<float>(sin(phase));
+        for(size_t k = 0; k < n; k++) {
+            // e^(+j(phase + k*increment)):
+            float re = baseRe * tableRe[k] - baseIm * tableIm[k];
+            float im = baseRe * tableIm[k] + baseIm * tableRe[k];
+            out[offset + k] = x[2 * (offset + k)] * re - x[2 * (offset + k) + 1] * im;
+        }
+        phase = remainder(phase + n * increment, 2.0 * M_PI);
+    }
+}
+
+ssb::ssb(double sampleRate, uint64_t N) : in(N), N(N), sampleRate(sampleRate), side(USB), cic(nullptr)
+{
+    // Split the decimation to the channel rate into an odd CIC factor and
+    // halfband stages:
+    decimation = static_cast<unsigned int>(std::lround(sampleRate / channelRate));
+    if(decimation == 0 || std::abs(decimation * channelRate - sampleRate) > 0.5) {
+        std::cout << "ERROR: SSB sample rate " << sampleRate << " is no multiple of " << channelRate << std::endl;
+        decimation = std::max(decimation, 1u);
+    }
+    cicFactor = decimation;
+    unsigned int halfbandCount = 0;
+    while(cicFactor % 2 == 0) {
+        cicFactor /= 2;
+        halfbandCount++;
+    }
+    interpolation = static_cast<unsigned int>(audioRate / channelRate);
+
+    // Third order CIC as FIR (a boxcar convolved three times), cheap at the
+    // full rate and the passband is tiny compared to its first null:
+    if(cicFactor > 1) {
+        std::vector<float> taps(1, 1.0f);
+        for(int order = 0; order < 3; order++) {
+            std::vector<float> next(taps.size() + cicFactor - 1, 0.0f);
+            for(size_t i = 0; i < taps.size(); i++) {
+                for(unsigned int k = 0; k < cicFactor; k++) {
+                    next[i + k] += taps[i] / static_cast<float>(cicFactor);
+                }
+            }
+            taps = next;
+        }
+        cic = firdecim_crcf_create(cicFactor, taps.data(), static_cast<unsigned int>(taps.size()));
+    }
+
+    for(unsigned int i = 0; i < halfbandCount; i++) {
+        halfbands.push_back(resamp2_crcf_create(6, 0.0f, 60.0f));
+    }
+
+    // The SSB filter runs at the channel rate, where it stays short:
+    float fc = static_cast<float>((highCut - lowCut) / 2.0 / channelRate);
+    channelFilter = firfilt_crcf_create_kaiser(121, fc, 60.0f, 0.0f);
+    firfilt_crcf_set_scale(channelFilter, 2.0f * fc);
+
+    interpolator = firinterp_rrrf_create_kaiser(interpolation, 8, 60.0f);
 
     // AGC:
     agc = agc_rrrf_create();
-    agc_rrrf_set_bandwidth(agc, 400.0f / (float)sample_rate_wav); // agc response
+    agc_rrrf_set_bandwidth(agc, 400.0f / static_cast<float>(audioRate)); // agc response
     agc_rrrf_set_scale(agc, 0.05f); // output audio scale (avoid clipping)
+
+    staged.resize(N + decimation);
+    stagedCount = 0;
+    channel.resize(staged.size() / cicFactor + 1);
+    baseband.resize(staged.size() / decimation + 1);
+    out.resize(baseband.size() * interpolation);
 }
 
 ssb::~ssb()
 {
-    nco_crcf_destroy(mixer);
-    rresamp_crcf_destroy(resamp);
-    ampmodem_destroy(demod);
+    if(cic != nullptr) {
+        firdecim_crcf_destroy(cic);
+    }
+    for(auto &halfband : halfbands) {
+        resamp2_crcf_destroy(halfband);
+    }
+    firfilt_crcf_destroy(channelFilter);
+    firinterp_rrrf_destroy(interpolator);
+    agc_rrrf_destroy(agc);
 }
 
-// https://gist.github.com/jgaeddert/846e781dbef25fd396f577d038e7d430
-void ssb::demodulate(uint64_t carrier)
-{ 
-    // Set the mixer frequency
-    //int nco_crcf_adjust_frequency(mixer, 0.0 );
-
-    // carrier/N*2*M_PI
-    float f = carrier/N*2*M_PI; //(4.0*M_PI*(float)(carrier) / 576'000.0f)-2*M_PI;
-    nco_crcf_set_frequency(mixer, f);
-
-    // mix down 'Q' samples
-    nco_crcf_mix_block_down(mixer, buf_0, buf_1, Q);
+unsigned int ssb::demodulate(double frequency, uint64_t count)
+{
+    // Weaver: center the passband at DC, after filtering move it back to
+    // [lowCut, highCut] (mirrored for LSB) and take the real part:
+    double pitch = (lowCut + highCut) / 2.0;
+    mixer.setFrequency(side == USB ? frequency + pitch : frequency - pitch, sampleRate);
+    weaver.setFrequency(side == USB ? pitch : -pitch, channelRate);
 
-    // resample 'Q' samples in buf_1 into 'P' samples in buf_0
-    rresamp_crcf_execute(resamp, buf_1, buf_0);
+    count = std::min(count, N);
+    mixer.mixDown(in.data(), staged.data() + stagedCount, count);
+    stagedCount += count;
 
-    // perform amplitude demodulation
-    ampmodem_demodulate_block(demod, buf_0, P, buf_2);
+    // Only complete decimation chunks go down the cascade:
+    count = stagedCount / decimation * decimation;
+    size_t usable = count;
+    if(cic != nullptr) {
+        count /= cicFactor;
+        firdecim_crcf_execute_block(cic, staged.data(), static_cast<unsigned int>(count), channel.data());
+    } else {
+        std::copy(staged.begin(), staged.begin() + count, channel.begin());
+    }
+    for(auto &halfband : halfbands) {
+        count /= 2;
+        for(size_t i = 0; i < count; i++) {
+            resamp2_crcf_decim_execute(halfband, &channel[2 * i], &channel[i]);
+        }
+    }
+    std::copy(staged.begin() + usable, staged.begin() + stagedCount, staged.begin());
+    stagedCount -= usable;
 
-    // apply automatic gain control
-    agc_rrrf_execute_block(agc, buf_2, P, out);
+    firfilt_crcf_execute_block(channelFilter, channel.data(), static_cast<unsigned int>(count), channel.data());
+    weaver.mixUpReal(channel.data(), baseband.data(), count);
 
-    // Demodulate the signal
-    //for (int i=0; i<N; i++) {
-    //    ampmodem_demodulate(demod, in[i], &out[i]);
-    //}
+    // Back to the audio rate and level:
+    firinterp_rrrf_execute_block(interpolator, baseband.data(), static_cast<unsigned int>(count), out.data());
+    unsigned int produced = static_cast<unsigned int>(count * interpolation);
+    agc_rrrf_execute_block(agc, out.data(), produced, out.data());
 
+    return produced;
 }
 
-audio::audio(float* buffer) : buffer(buffer)
+// Liquid leaves the taps unscaled:
+std::vector<float> kaiserLowpass(unsigned int length, float fc, float gain)
 {
-    err = Pa_Initialize();
-    if (err != paNoError) {
-        throw std::runtime_error("PortAudio error: (1) " + std::string(Pa_GetErrorText(err)));
+    std::vector<float> taps(length);
+    liquid_firdes_kaiser(length, fc, 60.0f, 0.0f, taps.data());
+    float sum = 0.0f;
+    for(float t : taps) {
+        sum += t;
     }
-
-    err = Pa_OpenDefaultStream(&stream,
-                               0,          // no input channels
-                               1,          // mono output
-                               paFloat32,  // 32 bit floating point output
-                               48000,      // sample rate
-                               256,        // frames per buffer
-                               nullptr,    // no callback, use blocking API
-                               nullptr);   // no callback userData
-    if (err != paNoError) {
-        Pa_Terminate();
-        throw std::runtime_error("PortAudio error: (2) " + std::string(Pa_GetErrorText(err)));
+    for(float &t : taps) {
+        t *= gain / sum;
     }
+    return taps;
+}
 
-    err = Pa_StartStream(stream);
-    if (err != paNoError) {
-        Pa_CloseStream(stream);
-        Pa_Terminate();
-        throw std::runtime_error("PortAudio error: (3) " + std::string(Pa_GetErrorText(err)));
+ssbModulator::ssbModulator(double sampleRate, size_t chunk) :
+    in(chunk),
+    sampleRate(sampleRate),
+    side(ssb::USB)
+{
+    decimation = static_cast<unsigned int>(ssb::audioRate / ssb::channelRate);
+    interpolation = static_cast<unsigned int>(std::lround(sampleRate / ssb::channelRate));
+    if(interpolation == 0 || std::abs(interpolation * ssb::channelRate - sampleRate) > 0.5) {
+        std::cout << "ERROR: SSB sample rate " << sampleRate << " is no multiple of " << ssb::channelRate << std::endl;
+        interpolation = std::max(interpolation, 1u);
     }
+
+    // Anti alias filter for the channel rate, the Weaver output is at most
+    // half the SSB bandwidth wide, so a short filter does:
+    std::vector<float> taps = kaiserLowpass(8 * decimation + 1, 0.5f / decimation, 1.0f);
+    decimator = firdecim_crcf_create(decimation, taps.data(), static_cast<unsigned int>(taps.size()));
+
+    // Same SSB filter as the receiver, at the channel rate:
+    float fc = static_cast<float>((ssb::highCut - ssb::lowCut) / 2.0 / ssb::channelRate);
+    channelFilter = firfilt_crcf_create_kaiser(channelTaps, fc, 60.0f, 0.0f);
+    firfilt_crcf_set_scale(channelFilter, 2.0f * fc);
+
+    // Zero stuffing costs a factor of `interpolation` in level, the filter
+    // gain makes up for it:
+    taps = kaiserLowpass(interpolatorTaps * interpolation + 1, 0.5f / interpolation, static_cast<float>(interpolation));
+    interpolator = firinterp_crcf_create(interpolation, taps.data(), static_cast<unsigned int>(taps.size()));
+
+    audio.resize(chunk);
+    channel.resize(chunk / decimation + 1);
+    out.resize(channel.size() * interpolation);
 }
 
-audio::~audio()
+ssbModulator::~ssbModulator()
 {
-    Pa_StopStream(stream);
-    Pa_CloseStream(stream);
-    Pa_Terminate();
+    firdecim_crcf_destroy(decimator);
+    firfilt_crcf_destroy(channelFilter);
+    firinterp_crcf_destroy(interpolator);
 }
 
-void audio::playback(uint64_t N)
+size_t ssbModulator::modulate(double frequency, size_t count, const std::complex<float> *channelOverride)
 {
-    err = Pa_WriteStream(stream, buffer, N);
-    //if (err != paNoError) {
-    //    Pa_StopStream(stream);
-    //    Pa_CloseStream(stream);
-    //    Pa_Terminate();
-    //    throw std::runtime_error("PortAudio error: (6) " + std::string(Pa_GetErrorText(err)));
-    //}
+    // Weaver: the passband [lowCut, highCut] (mirrored for LSB) is moved
+    // to DC and cut out, after interpolation it is moved up to the carrier:
+    double pitch = (ssb::lowCut + ssb::highCut) / 2.0;
+    weaver.setFrequency(side == ssb::USB ? pitch : -pitch, ssb::audioRate);
+    mixer.setFrequency(side == ssb::USB ? -(frequency + pitch) : -(frequency - pitch), sampleRate);
+
+    count = std::min(count, in.size()) / decimation * decimation;
+    for(size_t k = 0; k < count; k++) {
+        // A real tone splits into two halves, keep the full level:
+        audio[k] = std::complex<float>(2.0f * in[k], 0.0f);
+    }
+    weaver.mixDown(audio.data(), audio.data(), count);
 
-}
\ No newline at end of file
+    count /= decimation;
+    firdecim_crcf_execute_block(decimator, audio.data(), static_cast<unsigned int>(count), channel.data());
+    if(channelOverride != nullptr) {
+        std::copy(channelOverride, channelOverride + count, channel.begin());
+    }
+    firfilt_crcf_execute_block(channelFilter, channel.data(), static_cast<unsigned int>(count), channel.data());
+    firinterp_crcf_execute_block(interpolator, channel.data(), static_cast<unsigned int>(count), out.data());
+
+    // Mixing down by the negative carrier moves the signal up:
+    count *= interpolation;
+    mixer.mixDown(out.data(), out.data(), count);
+    return count;
+}
@@ -3,83 +3,176 @@
 
 #include <iostream>
 #include <complex>
+#include <vector>
 #include <fftw3.h>
 #include <liquid.h>
-#include <portaudio.h>
+#include "window.h"
+#include "fftplanner.h"
 
+// Spectrum engine, templated on the sample type (float uses fftwf_*,
+// double uses fftw_*). Window, FFT and the magnitude/dB stage all run in T.
+template <typename T>
 class fft 
 {
     public:
+    typedef typename fftwTraits<T>::complex complex;
+
     fft(uint64_t N = 4096);
     ~fft();
+    void resize(uint64_t N);
+    uint64_t getN() { return N; }
     void processSamples();
-    void shiftFft();
-    void hammingWindow();
-
-    static double bucketToFrequency(uint64_t bucketId, uint64_t N)
-    {
-        double baseQrg = 10'489'750'000.0; // Center frequency in Hz
-        double sampleRate = 576'000.0; // Sample rate in samples per second
-        double frequencyResolution = static_cast<double>(sampleRate) / static_cast<double>(N);
-        double frequencyOffset = static_cast<double>(bucketId) - static_cast<double>(N/2);
-        double frequency = baseQrg + frequencyOffset * frequencyResolution;
-        return frequency;
-    }
-
-    static uint64_t frequencyToBucket(uint64_t frequency, uint64_t N)
-    {
-        int64_t baseQrg = 10'489'750'000; // Center frequency in Hz
-        int64_t sampleRate = 576'000; // Sample rate in samples per second
-        int64_t frequencyResolution = sampleRate/N;
-        int64_t frequencyOffset = static_cast<int64_t>(frequency) - baseQrg;
-        int64_t bucketId = (frequencyOffset / frequencyResolution) + static_cast<int64_t>(N)/2;
-        return static_cast<uint64_t>(bucketId);
-    }
-
-    fftw_complex *in;
-    fftw_complex *out;
-    fftw_complex *shifted;
+    // The two halves of processSamples(), window + FFT and the dB stage:
+    void transform();
+    void powerSpectrum();
+    void setWindow(windowFunction::type t, double beta = 8.6);
+    windowFunction& getWindow() { return taper; }
+
+    // Power spectrum in dBFS, normalized so a full scale tone reads 0 dB:
+    const float* getSpectrum() { return spectrum.data(); }
+
+    complex *in;
+    complex *out;
 
     private:
-    fftw_plan p;
+    void allocate();
+    void release();
+
+    typename fftwTraits<T>::plan p;
+    uint64_t planGeneration; // Planner generation `p` was looked up at
     uint64_t N;
+    windowFunction taper;
+    std::vector<float> spectrum;
+};
+
+// Sample type of the spectrum pipeline. The ADC only delivers 12 bits, so
+// single precision is the default; define PLUTO17_DOUBLE_PRECISION for fftw.
+#ifdef PLUTO17_DOUBLE_PRECISION
+typedef double spectrumSample;
+#else
+typedef float spectrumSample;
+#endif
+typedef fft<spectrumSample> spectrumFft;
+
+// Kaiser lowpass taps (60 dB) with a DC gain of `gain`, cutoff relative to
+// the sample rate:
+std::vector<float> kaiserLowpass(unsigned int length, float fc, float gain);
+
+// Numerically controlled oscillator for mixing whole blocks. The phase is
+// accumulated in double once per chunk, within a chunk the samples are
+// rotated by a precomputed table, so the inner loop is plain multiply/add
+// which the compiler vectorizes.
+class oscillator {
+    public:
+    oscillator();
+    void setFrequency(double frequency, double sampleRate);
+
+    // out = in * e^(-j phi), in place is allowed:
+    void mixDown(const std::complex<float> *in, std::complex<float> *out, size_t count);
+    // out = Re(in * e^(+j phi)):
+    void mixUpReal(const std::complex<float> *in, float *out, size_t count);
+
+    private:
+    static constexpr size_t chunk = 64;
+    double phase;
+    double increment;
+    float tableRe[chunk];
+    float tableIm[chunk];
 };
 
+// Streaming SSB receiver (Weaver method). Whole IQ blocks are mixed so that
+// the center of the audio passband lands at DC, decimated by a CIC and a
+// halfband cascade to the channel rate, band limited there by a short
+// filter, mixed back up to audio and interpolated to the audio rate.
+// Filters and oscillators keep their state across blocks.
 class ssb {
     public:
-    ssb(uint64_t N = 4096);
+    enum sideband { USB, LSB };
+
+    ssb(double sampleRate = 576'000.0, uint64_t N = 4096);
     ~ssb();
-    void demodulate(uint64_t carrier);
-    std::array<std::complex<float>,4096> in;
-    //std::array<float,4096> out;
-    float *out;
+
+    // Demodulates `count` (at most N) samples of `in` at `frequency` Hz from
+    // the center of the baseband, returns the number of audio samples
+    // written to `out`:
+    unsigned int demodulate(double frequency, uint64_t count);
+    void setSideband(sideband s) { side = s; }
+    sideband getSideband() { return side; }
+
+    std::vector<std::complex<float>> in;
+    std::vector<float> out;
+
+    static constexpr double audioRate = 48'000.0;
+    static constexpr double channelRate = 12'000.0;
+    static constexpr double lowCut = 300.0; // Hz
+    static constexpr double highCut = 2'700.0; // Hz
 
     private:
     uint64_t N;
-    nco_crcf mixer;
-    ampmodem demod;
-    rresamp_crcf resamp;
+    double sampleRate;
+    sideband side;
+    unsigned int decimation; // sampleRate / channelRate
+    unsigned int cicFactor;
+    unsigned int interpolation; // audioRate / channelRate
+
+    oscillator mixer;
+    oscillator weaver;
+    firdecim_crcf cic;
+    std::vector<resamp2_crcf> halfbands;
+    firfilt_crcf channelFilter;
+    firinterp_rrrf interpolator;
     agc_rrrf agc;
-    unsigned int Q;
-    unsigned int P;
-    unsigned int buf_len;
-
-    // allocate buffers for sample processing (two each complex and real)
-    std::complex<float> *buf_0;
-    std::complex<float> *buf_1;
-    float *buf_2;
+
+    // Mixed samples waiting for a complete decimation chunk:
+    std::vector<std::complex<float>> staged;
+    size_t stagedCount;
+    std::vector<std::complex<float>> channel;
+    std::vector<float> baseband;
 };
 
-class audio {
+// Streaming SSB transmitter (Weaver method), the mirror image of ssb: the
+// microphone signal is mixed so that the center of the audio passband lands
+// at DC, decimated to the channel rate and band limited there, interpolated
+// to the Pluto rate and mixed up to the transmit offset.
+class ssbModulator {
     public:
-    audio(float* buffer);
-    ~audio();
-    void playback(uint64_t N);
+    ssbModulator(double sampleRate = 576'000.0, size_t chunk = 64);
+    ~ssbModulator();
+
+    // Modulates `count` (at most chunk, a multiple of the audio decimation)
+    // samples of `in` at `frequency` Hz from the center of the baseband,
+    // returns the number of IQ samples written to `out`. A full scale tone
+    // comes out with magnitude 1. `channelOverride` (count / decimation
+    // samples at the channel rate) replaces the audio in front of the SSB
+    // filter, e.g. with a measurement burst:
+    size_t modulate(double frequency, size_t count, const std::complex<float> *channelOverride = nullptr);
+    void setSideband(ssb::sideband s) { side = s; }
+    ssb::sideband getSideband() { return side; }
+    // IQ samples per audio sample:
+    unsigned int getInterpolation() { return interpolation * decimation; }
+    // Group delay from channelOverride to `out`, in channel rate samples:
+    double getOverrideDelay() { return (channelTaps - 1) / 2.0 + interpolatorTaps / 2.0; }
+
+    static constexpr unsigned int channelTaps = 121;
+    static constexpr unsigned int interpolatorTaps = 8; // per output phase
+
+    std::vector<float> in;
+    std::vector<std::complex<float>> out;
 
     private:
-    PaError err;
-    PaStream *stream;
-    float* buffer;
+    double sampleRate;
+    ssb::sideband side;
+    unsigned int decimation; // audioRate / channelRate
+    unsigned int interpolation; // sampleRate / channelRate
+
+    oscillator weaver;
+    oscillator mixer;
+    firdecim_crcf decimator;
+    firfilt_crcf channelFilter;
+    firinterp_crcf interpolator;
+
+    std::vector<std::complex<float>> audio;
+    std::vector<std::complex<float>> channel;
 };
 
 #endif
\ No newline at end of file
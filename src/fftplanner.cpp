@@ -0,0 +1,228 @@
+#include "fftplanner.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+
+unsigned fftPlannerBase::flags(rigor level)
+{
+    switch(level) {
+        case ESTIMATE: return FFTW_ESTIMATE;
+        case MEASURE: return FFTW_MEASURE;
+        case PATIENT: return FFTW_PATIENT;
+        case EXHAUSTIVE: return FFTW_EXHAUSTIVE;
+    }
+    return FFTW_ESTIMATE;
+}
+
+const char* fftPlannerBase::name(rigor level)
+{
+    switch(level) {
+        case ESTIMATE: return "Estimate";
+        case MEASURE: return "Measure";
+        case PATIENT: return "Patient";
+        case EXHAUSTIVE: return "Exhaustive";
+    }
+    return "";
+}
+
+// $XDG_CONFIG_HOME/pluto17 or ~/.config/pluto17, empty if neither is known
+std::string fftPlannerBase::configDir()
+{
+    std::filesystem::path dir;
+    if(const char* xdg = std::getenv("XDG_CONFIG_HOME")) {
+        dir = std::filesystem::path(xdg) / "pluto17";
+    } else if(const char* home = std::getenv("HOME")) {
+        dir = std::filesystem::path(home) / ".config" / "pluto17";
+    } else {
+        return "";
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    return dir.string();
+}
+
+template <typename T>
+fftPlanner<T>& fftPlanner<T>::instance()
+{
+    static fftPlanner planner;
+    return planner;
+}
+
+// Measured plans are noticeably faster than estimated ones, the wisdom file
+// makes that a one time cost per machine
+template <typename T>
+fftPlanner<T>::fftPlanner() : level(MEASURE), generation(0), stopping(false)
+{
+    std::string dir = configDir();
+    if(!dir.empty()) {
+        wisdomFile = (std::filesystem::path(dir) / fftwTraits<T>::wisdomName).string();
+        if(fftwTraits<T>::importWisdom(wisdomFile.c_str())) {
+            std::cout << "Loaded FFTW wisdom from " << wisdomFile << std::endl;
+        }
+    }
+}
+
+template <typename T>
+fftPlanner<T>::~fftPlanner()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobsChanged.notify_all();
+    if(worker.joinable()) {
+        worker.join();
+    }
+    for(auto &plan : plans) {
+        fftwTraits<T>::destroy(plan.second.first);
+    }
+    for(auto &plan : retired) {
+        fftwTraits<T>::destroy(plan);
+    }
+}
+
+template <typename T>
+void fftPlanner<T>::setRigor(rigor level)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->level = level;
+}
+
+template <typename T>
+typename fftPlanner<T>::rigor fftPlanner<T>::getRigor()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return level;
+}
+
+template <typename T>
+typename fftPlanner<T>::plan fftPlanner<T>::getPlan(uint64_t N, int direction)
+{
+    // Reuse a cached plan unless a more rigorous one was requested since:
+    rigor wanted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto cached = plans.find(std::make_pair(N, direction));
+        if(cached != plans.end() && cached->second.second >= level) {
+            return cached->second.first;
+        }
+        wanted = level;
+    }
+    return create(N, direction, wanted);
+}
+
+template <typename T>
+typename fftPlanner<T>::plan fftPlanner<T>::getPlanNow(uint64_t N, int direction)
+{
+    auto key = std::make_pair(N, direction);
+    plan p = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto cached = plans.find(key);
+        if(cached != plans.end()) {
+            if(cached->second.second >= level) {
+                return cached->second.first;
+            }
+            // The less rigorous plan keeps serving meanwhile:
+            p = cached->second.first;
+        }
+    }
+
+    // Estimating takes well under a millisecond. It is done before the
+    // background job is queued, so it only waits if a measurement of
+    // another size still holds the FFTW planner:
+    if(p == nullptr) {
+        p = create(N, direction, ESTIMATE);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(level != ESTIMATE) {
+        if(std::find(jobs.begin(), jobs.end(), key) == jobs.end()) {
+            jobs.push_back(key);
+        }
+        if(!worker.joinable()) {
+            worker = std::thread(&fftPlanner::run, this);
+        }
+        jobsChanged.notify_one();
+    }
+    return p;
+}
+
+// Runs on the background planner thread
+template <typename T>
+void fftPlanner<T>::run()
+{
+    while(true) {
+        std::pair<uint64_t, int> key;
+        rigor wanted;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobsChanged.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if(stopping) {
+                return;
+            }
+            key = jobs.front();
+            jobs.pop_front();
+            wanted = level;
+        }
+        create(key.first, key.second, wanted);
+    }
+}
+
+template <typename T>
+typename fftPlanner<T>::plan fftPlanner<T>::create(uint64_t N, int direction, rigor wanted)
+{
+    std::lock_guard<std::mutex> planningLock(planning);
+
+    // Someone else may have planned it while this waited:
+    auto key = std::make_pair(N, direction);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto cached = plans.find(key);
+        if(cached != plans.end() && cached->second.second >= wanted) {
+            return cached->second.first;
+        }
+    }
+
+    // Measuring overwrites the arrays, so plan on scratch buffers. Plans
+    // are created out of place with fftw_malloc alignment, which is what
+    // every fft instance uses for fftw_execute_dft():
+    typedef typename fftwTraits<T>::complex complex;
+    complex *in = (complex*) fftwTraits<T>::malloc(sizeof(complex) * N);
+    complex *out = (complex*) fftwTraits<T>::malloc(sizeof(complex) * N);
+    plan p = fftwTraits<T>::planDft(N, in, out, direction, flags(wanted));
+    fftwTraits<T>::free(in);
+    fftwTraits<T>::free(out);
+
+    {
+        // Instances may still execute the old plan, it is kept until exit:
+        std::lock_guard<std::mutex> lock(mutex);
+        auto cached = plans.find(key);
+        if(cached != plans.end()) {
+            std::cout << "Replanning FFT N=" << N << " (" << name(wanted) << ")" << std::endl;
+            retired.push_back(cached->second.first);
+            generation++;
+        }
+        plans[key] = std::make_pair(p, wanted);
+    }
+
+    if(wanted != ESTIMATE && !wisdomFile.empty()) {
+        fftwTraits<T>::exportWisdom(wisdomFile.c_str());
+    }
+    return p;
+}
+
+template <typename T>
+bool fftPlanner<T>::saveWisdom()
+{
+    std::lock_guard<std::mutex> lock(planning);
+    if(wisdomFile.empty()) {
+        return false;
+    }
+    return fftwTraits<T>::exportWisdom(wisdomFile.c_str()) != 0;
+}
+
+template class fftPlanner<float>;
+template class fftPlanner<double>;
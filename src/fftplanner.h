@@ -0,0 +1,109 @@
+#ifndef FFTPLANNER_H
+#define FFTPLANNER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fftw3.h>
+
+// Maps a sample type onto the matching FFTW API (fftw_* or fftwf_*)
+template <typename T>
+struct fftwTraits;
+
+template <>
+struct fftwTraits<double> {
+    typedef fftw_complex complex;
+    typedef fftw_plan plan;
+    static void* malloc(size_t n) { return fftw_malloc(n); }
+    static void free(void *p) { fftw_free(p); }
+    static plan planDft(int N, complex *in, complex *out, int direction, unsigned flags) { return fftw_plan_dft_1d(N, in, out, direction, flags); }
+    static void execute(const plan p, complex *in, complex *out) { fftw_execute_dft(p, in, out); }
+    static void destroy(plan p) { fftw_destroy_plan(p); }
+    static int importWisdom(const char *file) { return fftw_import_wisdom_from_filename(file); }
+    static int exportWisdom(const char *file) { return fftw_export_wisdom_to_filename(file); }
+    static constexpr const char* wisdomName = "fftw-wisdom";
+};
+
+template <>
+struct fftwTraits<float> {
+    typedef fftwf_complex complex;
+    typedef fftwf_plan plan;
+    static void* malloc(size_t n) { return fftwf_malloc(n); }
+    static void free(void *p) { fftwf_free(p); }
+    static plan planDft(int N, complex *in, complex *out, int direction, unsigned flags) { return fftwf_plan_dft_1d(N, in, out, direction, flags); }
+    static void execute(const plan p, complex *in, complex *out) { fftwf_execute_dft(p, in, out); }
+    static void destroy(plan p) { fftwf_destroy_plan(p); }
+    static int importWisdom(const char *file) { return fftwf_import_wisdom_from_filename(file); }
+    static int exportWisdom(const char *file) { return fftwf_export_wisdom_to_filename(file); }
+    static constexpr const char* wisdomName = "fftwf-wisdom";
+};
+
+class fftPlannerBase {
+    public:
+    enum rigor { ESTIMATE, MEASURE, PATIENT, EXHAUSTIVE };
+    static const char* name(rigor level);
+
+    protected:
+    static unsigned flags(rigor level);
+    static std::string configDir();
+};
+
+// Process wide FFTW plan cache, one per precision. Plans are shared by every
+// fft instance of the same size and direction and executed with
+// fftw(f)_execute_dft() on the instance's own (fftw_malloc aligned) buffers.
+// Wisdom is loaded from and saved to the user's config dir, so expensive
+// planning is done once per machine. getPlanNow() is for callers that must
+// not stall (a live FFT size switch on the GUI thread): it hands out an
+// ESTIMATE plan at once and measures the rigorous one on a background
+// thread, instances swap it in when getGeneration() changes.
+template <typename T>
+class fftPlanner : public fftPlannerBase {
+    public:
+    typedef typename fftwTraits<T>::plan plan;
+
+    static fftPlanner& instance();
+
+    void setRigor(rigor level);
+    rigor getRigor();
+    plan getPlan(uint64_t N, int direction);
+    plan getPlanNow(uint64_t N, int direction);
+    // Bumped whenever a cached plan is replaced by a more rigorous one:
+    uint64_t getGeneration() { return generation; }
+    bool saveWisdom();
+    std::string getWisdomFile() { return wisdomFile; }
+
+    private:
+    fftPlanner();
+    ~fftPlanner();
+    fftPlanner(const fftPlanner&) = delete;
+    fftPlanner& operator=(const fftPlanner&) = delete;
+
+    plan create(uint64_t N, int direction, rigor wanted);
+    void run();
+
+    // FFTW planning (and wisdom export) is not thread safe, executing plans
+    // is. `planning` serializes the FFTW calls, `mutex` guards the cache, so
+    // lookups never wait for a measurement:
+    std::mutex planning;
+    std::mutex mutex;
+    std::map<std::pair<uint64_t, int>, std::pair<plan, rigor>> plans;
+    std::vector<plan> retired;
+    rigor level;
+    std::string wisdomFile;
+    std::atomic<uint64_t> generation;
+
+    // Background planning, started on the first getPlanNow():
+    std::thread worker;
+    std::condition_variable jobsChanged;
+    std::deque<std::pair<uint64_t, int>> jobs;
+    bool stopping;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#include "frequencyplan.h"
+#include <algorithm>
+
+frequencyPlan::frequencyPlan(double sampleRate, double centerFrequency, double loOffset, uint64_t N)
+    : sampleRate(sampleRate), centerFrequency(centerFrequency), loOffset(loOffset), correction(0.0), N(N)
+{
+}
+
+void frequencyPlan::setN(uint64_t N)
+{
+    this->N = std::clamp(N, minN, maxN);
+}
+
+double frequencyPlan::bucketToFrequency(double bucket) const
+{
+    uint64_t n = getN();
+    double frequencyOffset = bucket - static_cast<double>(n / 2);
+    return getCenterFrequency() + frequencyOffset * getSampleRate() / static_cast<double>(n) - getCorrection();
+}
+
+double frequencyPlan::frequencyToBucket(double frequency) const
+{
+    uint64_t n = getN();
+    double frequencyOffset = toCorrectedBaseband(frequency);
+    return frequencyOffset * static_cast<double>(n) / getSampleRate() + static_cast<double>(n / 2);
+}
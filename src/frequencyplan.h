@@ -0,0 +1,62 @@
+#ifndef FREQUENCYPLAN_H
+#define FREQUENCYPLAN_H
+
+#include <atomic>
+#include <cstdint>
+
+// Single source of truth for the receive frequency layout: sample rate,
+// displayed center frequency, LNB local oscillator offset, its measured
+// drift (correction) and FFT size.
+// All fields are atomics, the acquisition and DSP threads read them
+// while the GUI changes them. Consumers compare getN() with their own
+// size and adapt on their next frame.
+class frequencyPlan {
+    public:
+    frequencyPlan(
+        double sampleRate = 576'000.0,
+        double centerFrequency = 10'489'750'000.0,
+        double loOffset = 9'749'975'946.0,
+        uint64_t N = 4096
+    );
+
+    double getSampleRate() const { return sampleRate.load(); }
+    double getCenterFrequency() const { return centerFrequency.load(); }
+    double getLoOffset() const { return loOffset.load(); }
+    uint64_t getN() const { return N.load(); }
+    // Where signals actually are in baseband minus where they should be,
+    // in Hz (the LNB drift, measured on the beacon):
+    double getCorrection() const { return correction.load(); }
+
+    void setCenterFrequency(double frequency) { centerFrequency = frequency; }
+    void setLoOffset(double offset) { loOffset = offset; }
+    void setN(uint64_t N);
+    void setCorrection(double offset) { correction = offset; }
+
+    // Frequency the Pluto has to be tuned to (after the LNB):
+    double getRxFrequency() const { return getCenterFrequency() - getLoOffset(); }
+
+    double getBinWidth() const { return getSampleRate() / static_cast<double>(getN()); }
+
+    // Conversions between (fractional) FFT bins and absolute frequencies in
+    // Hz, the bins are where the signals are, so the correction applies:
+    double bucketToFrequency(double bucket) const;
+    double frequencyToBucket(double frequency) const;
+
+    // Offset of an absolute frequency from the center (baseband) in Hz,
+    // without correction. Tuned frequencies are kept like this and the
+    // NCOs add the correction, so they follow the drift:
+    double toBaseband(double frequency) const { return frequency - getCenterFrequency(); }
+    double toCorrectedBaseband(double frequency) const { return toBaseband(frequency) + getCorrection(); }
+
+    static constexpr uint64_t minN = 1024;
+    static constexpr uint64_t maxN = 65536;
+
+    private:
+    std::atomic<double> sampleRate;
+    std::atomic<double> centerFrequency;
+    std::atomic<double> loOffset;
+    std::atomic<double> correction;
+    std::atomic<uint64_t> N;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "gapdetector.h"
+#include <cmath>
+#include <iostream>
+
+gapDetector::gapDetector(double sampleRate, uint64_t blockSize, unsigned kernelBuffers) :
+    sampleRate(sampleRate),
+    blockSize(blockSize),
+    kernelBuffers(kernelBuffers),
+    resetRequested(false),
+    started(false),
+    received(0),
+    lagFloor(0.0),
+    hasFloor(false),
+    droppedSamples(0),
+    gaps(0),
+    lag(0.0)
+{
+}
+
+void gapDetector::reset(unsigned kernelBuffers)
+{
+    this->kernelBuffers = kernelBuffers;
+    resetRequested = true;
+}
+
+uint64_t gapDetector::update(uint64_t count, std::chrono::steady_clock::duration waited)
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if(resetRequested.exchange(false)) {
+        started = false;
+        received = 0;
+        hasFloor = false;
+        lag = 0.0;
+    }
+
+    // The first block may have been sitting in the kernel for a while, the
+    // clock starts when it is through:
+    if(!started) {
+        started = true;
+        start = now;
+        return 0;
+    }
+    received += count;
+
+    double elapsed = std::chrono::duration<double>(now - start).count();
+    double current = elapsed * sampleRate - static_cast<double>(received);
+    double blockDuration = static_cast<double>(blockSize) / sampleRate;
+    bool idle = std::chrono::duration<double>(waited).count() > 0.5 * blockDuration;
+    lag = current / sampleRate;
+
+    double lost = 0.0;
+    if(idle) {
+        if(!hasFloor) {
+            lagFloor = current;
+            hasFloor = true;
+        } else if(current - lagFloor > 0.5 * blockSize) {
+            lost = current - lagFloor;
+        } else {
+            // Jitter and clock drift:
+            lagFloor += 0.05 * (current - lagFloor);
+        }
+    } else if(hasFloor && current - lagFloor > static_cast<double>(kernelBuffers + 1) * blockSize) {
+        // More behind than the kernel can buffer, at least the excess is
+        // gone:
+        lost = current - lagFloor - static_cast<double>(kernelBuffers) * blockSize;
+    }
+
+    if(lost <= 0.0) {
+        return 0;
+    }
+
+    // The hardware drops whole buffers:
+    uint64_t samples = std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(lost / blockSize))) * blockSize;
+    lagFloor += static_cast<double>(samples);
+    droppedSamples += samples;
+    gaps++;
+
+    std::cout << "WARNING: Lost " << samples << " samples at " << elapsed << " s into the stream" << std::endl;
+
+    std::lock_guard<std::mutex> lock(eventMutex);
+    events.push_back({std::chrono::system_clock::now(), elapsed, samples});
+    if(events.size() > historySize) {
+        events.pop_front();
+    }
+    return samples;
+}
+
+std::vector<gapDetector::event> gapDetector::getEvents()
+{
+    std::lock_guard<std::mutex> lock(eventMutex);
+    return std::vector<event>(events.begin(), events.end());
+}
@@ -0,0 +1,67 @@
+#ifndef GAPDETECTOR_H
+#define GAPDETECTOR_H
+
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Detects samples the kernel dropped (all libiio buffers full) by comparing
+// the samples received with the time the stream has been running. The lag
+// (expected - received) only has a reliable floor while the reader waits
+// in iio_buffer_refill(), i.e. while no buffer is queued; a jump of that
+// floor by more than half a block is lost data. A lag beyond what all
+// kernel buffers can hold is lost data as well, even if the reader never
+// catches up. The floor follows slowly, so clock drift between the Pluto
+// and the host does not add up to false gaps.
+class gapDetector {
+    public:
+    struct event {
+        std::chrono::system_clock::time_point time;
+        double streamTime; // Seconds since the stream started
+        uint64_t samples;
+    };
+
+    gapDetector(double sampleRate, uint64_t blockSize, unsigned kernelBuffers);
+
+    // Restarts the clock with the next block, e.g. after (re)connecting.
+    // Safe to call while the acquisition thread runs:
+    void reset(unsigned kernelBuffers);
+
+    // Called by the acquisition thread after every block, `waited` is how
+    // long the read blocked. Returns the samples lost before this block:
+    uint64_t update(uint64_t count, std::chrono::steady_clock::duration waited);
+
+    uint64_t getDroppedSamples() const { return droppedSamples; }
+    uint64_t getGaps() const { return gaps; }
+    double getLag() const { return lag; }
+    unsigned getKernelBuffers() const { return kernelBuffers; }
+    // Most recent last:
+    std::vector<event> getEvents();
+
+    static constexpr size_t historySize = 256;
+
+    private:
+    double sampleRate;
+    uint64_t blockSize;
+    std::atomic<unsigned> kernelBuffers;
+    std::atomic<bool> resetRequested;
+
+    // Acquisition thread only:
+    std::chrono::steady_clock::time_point start;
+    bool started;
+    uint64_t received;
+    double lagFloor;
+    bool hasFloor;
+
+    std::atomic<uint64_t> droppedSamples;
+    std::atomic<uint64_t> gaps;
+    std::atomic<double> lag;
+
+    std::mutex eventMutex;
+    std::deque<event> events;
+};
+
+#endif
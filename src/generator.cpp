@@ -0,0 +1,480 @@
+#include "generator.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+xoshiro::xoshiro(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+// The state is expanded from the seed with splitmix64, as recommended:
+void xoshiro::seed(uint64_t seed)
+{
+    for(int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        s[i] = z ^ (z >> 31);
+    }
+}
+
+nco::nco() : phase(0.0), increment(0.0)
+{
+}
+
+void nco::setFrequency(double frequency, double sampleRate)
+{
+    increment = 2.0 * M_PI * frequency / sampleRate;
+}
+
+void nco::generate(std::complex<float> *out, size_t count)
+{
+    std::complex<double> step = std::polar(1.0, increment);
+    std::complex<double> stride = std::polar(1.0, increment * lanes);
+    float strideRe = static_cast<float>(stride.real());
+    float strideIm = static_cast<float>(stride.imag());
+
+    for(size_t base = 0; base < count; base += chunk) {
+        size_t n = std::min(chunk, count - base);
+
+        float re[lanes];
+        float im[lanes];
+        std::complex<double> z = std::polar(1.0, phase);
+        for(size_t k = 0; k < lanes; k++) {
+            re[k] = static_cast<float>(z.real());
+            im[k] = static_cast<float>(z.imag());
+            z *= step;
+        }
+
+        for(size_t i = 0; i < n; i += lanes) {
+            size_t m = std::min(lanes, n - i);
+            for(size_t k = 0; k < m; k++) {
+                out[base + i + k] = std::complex<float>(re[k], im[k]);
+            }
+            for(size_t k = 0; k < lanes; k++) {
+                float r = re[k] * strideRe - im[k] * strideIm;
+                im[k] = re[k] * strideIm + im[k] * strideRe;
+                re[k] = r;
+            }
+        }
+
+        phase = std::remainder(phase + increment * n, 2.0 * M_PI);
+    }
+}
+
+generator::generator(double sampleRate) : sampleRate(sampleRate), seed(17), noiseAmplitude(0.0f)
+{
+    loadDefault();
+}
+
+void generator::setSampleRate(double sampleRate)
+{
+    std::lock_guard<std::mutex> lock(scenarioMutex);
+    this->sampleRate = sampleRate;
+    for(auto &e : emitters) {
+        prepare(e);
+    }
+}
+
+// A few signals in the QO-100 narrowband segments around the default
+// center, plus the 210.9 Hz carrier the old fake source produced:
+void generator::loadDefault()
+{
+    std::lock_guard<std::mutex> lock(scenarioMutex);
+    builtin();
+}
+
+void generator::builtin()
+{
+    scenario = "built-in";
+    seed = 17;
+    random.seed(seed);
+    noiseAmplitude = static_cast<float>(pow(10.0, -60.0 / 20.0) / sqrt(2.0));
+    emitters.clear();
+    addEmitter(TONE, 210.9375, -20.0, "");
+    addEmitter(TONE, -248'000.0, -30.0, "");
+    addEmitter(CW, -225'000.0, -40.0, "22 CQ CQ DE DL1ABC DL1ABC K");
+    addEmitter(CW, -214'500.0, -48.0, "16 TEST DE PLUTO17");
+    addEmitter(PSK, -195'000.0, -45.0, "PLUTO17 BEACON");
+    addEmitter(SSB, -60'000.0, -35.0, "usb");
+    addEmitter(SSB, 40'000.0, -38.0, "usb");
+    addEmitter(SSB, 75'000.0, -44.0, "usb");
+}
+
+bool generator::load(const std::string &path)
+{
+    if(path.empty()) {
+        loadDefault();
+        return true;
+    }
+
+    std::ifstream file(path);
+    if(!file) {
+        std::cout << "ERROR: Cannot read scenario " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(scenarioMutex);
+    scenario = path;
+    seed = 17;
+    noiseAmplitude = 0.0f;
+    emitters.clear();
+
+    std::string line;
+    int number = 0;
+    while(std::getline(file, line)) {
+        number++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string keyword;
+        if(!(words >> keyword)) {
+            continue;
+        }
+
+        bool ok = true;
+        if(keyword == "seed") {
+            ok = static_cast<bool>(words >> seed);
+        } else if(keyword == "noise") {
+            double level;
+            ok = static_cast<bool>(words >> level);
+            noiseAmplitude = static_cast<float>(pow(10.0, level / 20.0) / sqrt(2.0));
+        } else {
+            double frequency, level;
+            std::string arguments;
+            ok = static_cast<bool>(words >> frequency >> level);
+            std::getline(words, arguments);
+            if(!ok) {
+            } else if(keyword == "tone") {
+                ok = addEmitter(TONE, frequency, level, arguments);
+            } else if(keyword == "cw") {
+                ok = addEmitter(CW, frequency, level, arguments);
+            } else if(keyword == "ssb") {
+                ok = addEmitter(SSB, frequency, level, arguments);
+            } else if(keyword == "psk") {
+                ok = addEmitter(PSK, frequency, level, arguments);
+            } else {
+                ok = false;
+            }
+        }
+
+        if(!ok) {
+            std::cout << "ERROR: " << path << ":" << number << ": cannot parse '" << line << "'" << std::endl;
+            builtin();
+            return false;
+        }
+    }
+
+    random.seed(seed);
+    std::cout << "Scenario " << path << ": " << emitters.size() << " emitters" << std::endl;
+    return true;
+}
+
+bool generator::addEmitter(kind type, double frequency, double level, const std::string &arguments)
+{
+    if(std::abs(frequency) >= sampleRate / 2.0) {
+        return false;
+    }
+
+    emitter e{};
+    e.type = type;
+    e.frequency = frequency;
+    e.amplitude = static_cast<float>(pow(10.0, level / 20.0));
+
+    std::istringstream words(arguments);
+    if(type == CW) {
+        if(!(words >> e.wpm) || e.wpm <= 0.0) {
+            return false;
+        }
+    } else if(type == SSB) {
+        std::string side;
+        words >> side;
+        e.lsb = side == "lsb" || side == "LSB";
+    }
+    std::getline(words >> std::ws, e.text);
+    if((type == CW || type == PSK) && e.text.empty()) {
+        return false;
+    }
+
+    prepare(e);
+    emitters.push_back(std::move(e));
+    return true;
+}
+
+// (Re)derives everything that depends on the sample rate
+void generator::prepare(emitter &e)
+{
+    // Envelope time constants: ~2 ms CW rise time (no key clicks), 15 ms for
+    // the SSB syllables. The SSB noise is low passed to half of the 2.4 kHz
+    // voice bandwidth at ~24 kHz and shifted to the middle of the passband.
+    // Two poles plus the linear interpolation keep the images ~75 dB down:
+    ssbDecimation = std::max<uint64_t>(1, static_cast<uint64_t>(sampleRate / 24'000.0));
+    double ssbRate = sampleRate / ssbDecimation;
+    cwAlpha = static_cast<float>(1.0 - exp(-1.0 / (0.001 * sampleRate)));
+    burstAlpha = static_cast<float>(1.0 - exp(-1.0 / (0.015 * ssbRate)));
+    ssbAlpha = static_cast<float>(1.0 - exp(-2.0 * M_PI * 1'200.0 / ssbRate));
+
+    // PSK31: 31.25 Bd, a phase reversal is a cosine shaped zero crossing:
+    size_t symbol = static_cast<size_t>(round(sampleRate / 31.25));
+    pskShape.resize(symbol);
+    for(size_t n = 0; n < symbol; n++) {
+        pskShape[n] = static_cast<float>(cos(M_PI * n / symbol));
+    }
+
+    double frequency = e.frequency;
+    e.position = 0;
+    e.elapsed = 0;
+    e.envelope = 0.0f;
+    e.target = 0.0f;
+    e.sign = 1.0f;
+    switch(e.type) {
+        case CW:
+            e.pattern = morse(e.text);
+            e.elementLength = static_cast<uint64_t>(round(1.2 / e.wpm * sampleRate));
+            break;
+        case PSK:
+            e.pattern = bits(e.text);
+            e.elementLength = symbol;
+            break;
+        case SSB: {
+            frequency += e.lsb ? -1'500.0 : 1'500.0;
+            e.burstRemaining = 0;
+
+            // Noise power gain of the two pole low pass, from its impulse
+            // response, so the burst level matches the configured one:
+            double a = ssbAlpha, y1 = 0.0, y2 = 0.0, power = 0.0;
+            for(int n = 0; n < 20.0 / a; n++) {
+                y1 += a * ((n == 0 ? 1.0 : 0.0) - y1);
+                y2 += a * (y1 - y2);
+                power += y2 * y2;
+            }
+            // Two unit variance components:
+            e.gain = static_cast<float>(e.amplitude / sqrt(2.0 * power));
+            break;
+        }
+        default:
+            break;
+    }
+    e.carrier.setFrequency(frequency, sampleRate);
+}
+
+// One entry per dot length, 1 = key down. Dot 1, dash 3, gaps 1/3/7 and a
+// long pause before the message repeats
+std::vector<uint8_t> generator::morse(const std::string &text)
+{
+    static const char *letters[] = {
+        ".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..", ".---", "-.-", ".-..", "--",
+        "-.", "---", ".--.", "--.-", ".-.", "...", "-", "..-", "...-", ".--", "-..-", "-.--", "--.."
+    };
+    static const char *digits[] = {
+        "-----", ".----", "..---", "...--", "....-", ".....", "-....", "--...", "---..", "----."
+    };
+
+    std::vector<uint8_t> pattern;
+    for(char c : text) {
+        const char *code = nullptr;
+        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        if(c >= 'A' && c <= 'Z') {
+            code = letters[c - 'A'];
+        } else if(c >= '0' && c <= '9') {
+            code = digits[c - '0'];
+        } else if(c == '/') {
+            code = "-..-.";
+        } else if(c == '?') {
+            code = "..--..";
+        } else if(c == '=') {
+            code = "-...-";
+        } else if(c == ' ') {
+            pattern.insert(pattern.end(), 4, 0); // 3 already follow the letter
+            continue;
+        } else {
+            continue;
+        }
+        for(const char *p = code; *p; p++) {
+            pattern.insert(pattern.end(), *p == '-' ? 3 : 1, 1);
+            pattern.push_back(0);
+        }
+        pattern.insert(pattern.end(), 2, 0);
+    }
+    pattern.insert(pattern.end(), 14, 0);
+    return pattern;
+}
+
+// 8 bits per character, MSB first, separated by "00" like the varicode
+// character gap, and a run of reversals (idle) before each repetition
+std::vector<uint8_t> generator::bits(const std::string &text)
+{
+    std::vector<uint8_t> pattern(32, 0);
+    for(unsigned char c : text) {
+        for(int b = 7; b >= 0; b--) {
+            pattern.push_back((c >> b) & 1);
+        }
+        pattern.insert(pattern.end(), 2, 0);
+    }
+    return pattern;
+}
+
+void generator::render(emitter &e, std::complex<float> *out, size_t count)
+{
+    std::complex<float> *c = phasors.data();
+    e.carrier.generate(c, count);
+
+    switch(e.type) {
+        case TONE:
+            for(size_t n = 0; n < count; n++) {
+                out[n] += e.amplitude * c[n];
+            }
+            break;
+
+        case CW: {
+            // Element by element, the envelope only needs the per sample
+            // recursion on the edges:
+            float amplitude = e.amplitude;
+            float envelope = e.envelope;
+            size_t n = 0;
+            while(n < count) {
+                if(e.elapsed == e.elementLength) {
+                    e.elapsed = 0;
+                    e.position = (e.position + 1) % e.pattern.size();
+                }
+                size_t end = n + std::min<uint64_t>(count - n, e.elementLength - e.elapsed);
+                float target = e.pattern[e.position];
+                e.elapsed += end - n;
+
+                if(envelope == target) {
+                    if(target != 0.0f) {
+                        for(; n < end; n++) {
+                            out[n] += amplitude * c[n];
+                        }
+                    }
+                    n = end;
+                    continue;
+                }
+                for(; n < end; n++) {
+                    envelope += cwAlpha * (target - envelope);
+                    // Snap once settled, the decay would run into denormals:
+                    if(std::abs(target - envelope) < 1e-6f) {
+                        envelope = target;
+                    }
+                    out[n] += (amplitude * envelope) * c[n];
+                }
+            }
+            e.envelope = envelope;
+            break;
+        }
+
+        case PSK: {
+            // A 0 reverses the phase, shaped over the whole symbol, a 1
+            // keeps the carrier steady:
+            size_t n = 0;
+            while(n < count) {
+                if(e.elapsed == e.elementLength) {
+                    e.elapsed = 0;
+                    if(e.pattern[e.position] == 0) {
+                        e.sign = -e.sign;
+                    }
+                    e.position = (e.position + 1) % e.pattern.size();
+                }
+                size_t run = std::min<uint64_t>(count - n, e.elementLength - e.elapsed);
+                float a = e.amplitude * e.sign;
+                if(e.pattern[e.position]) {
+                    for(size_t i = 0; i < run; i++) {
+                        out[n + i] += a * c[n + i];
+                    }
+                } else {
+                    const float *shape = pskShape.data() + e.elapsed;
+                    for(size_t i = 0; i < run; i++) {
+                        out[n + i] += (a * shape[i]) * c[n + i];
+                    }
+                }
+                e.elapsed += run;
+                n += run;
+            }
+            break;
+        }
+
+        case SSB:
+            // Talk spurts of 50-300 ms syllables at random levels, about a
+            // third of them silent. The state lives in locals for the loop,
+            // out could alias the emitter as far as the compiler knows:
+            {
+                xoshiro rng = random;
+                uint64_t tick = e.elapsed;
+                uint64_t remaining = e.burstRemaining;
+                float target = e.target;
+                float envelope = e.envelope;
+                std::complex<float> value = e.value;
+                std::complex<float> delta = e.delta;
+                for(size_t n = 0; n < count; n++) {
+                    if(tick == 0) {
+                        // Next sample at the reduced rate:
+                        if(remaining == 0) {
+                            remaining = static_cast<uint64_t>((0.05 + 0.25 * rng.uniform()) * sampleRate / ssbDecimation);
+                            target = rng.uniform() < 0.35 ? 0.0f : static_cast<float>(0.3 + 0.7 * rng.uniform());
+                        }
+                        remaining--;
+                        envelope += burstAlpha * (target - envelope);
+                        if(std::abs(target - envelope) < 1e-6f) {
+                            envelope = target;
+                        }
+
+                        std::complex<float> noise(rng.gaussian(), rng.gaussian());
+                        e.lowpass1 += ssbAlpha * (noise - e.lowpass1);
+                        e.lowpass2 += ssbAlpha * (e.lowpass1 - e.lowpass2);
+                        delta = (e.gain * envelope * e.lowpass2 - value) / static_cast<float>(ssbDecimation);
+                        tick = ssbDecimation;
+                    }
+                    tick--;
+                    value += delta;
+
+                    // Spelled out, std::complex multiplication checks for NaN:
+                    float re = value.real() * c[n].real() - value.imag() * c[n].imag();
+                    float im = value.real() * c[n].imag() + value.imag() * c[n].real();
+                    out[n] += std::complex<float>(re, im);
+                }
+                random = rng;
+                e.elapsed = tick;
+                e.burstRemaining = remaining;
+                e.target = target;
+                e.envelope = envelope;
+                e.value = value;
+                e.delta = delta;
+            }
+            break;
+    }
+}
+
+void generator::generate(std::complex<float> *out, size_t count)
+{
+    std::lock_guard<std::mutex> lock(scenarioMutex);
+    if(phasors.size() < count) {
+        phasors.resize(count);
+    }
+
+    xoshiro rng = random;
+    for(size_t n = 0; n < count; n++) {
+        out[n] = noiseAmplitude * std::complex<float>(rng.gaussian(), rng.gaussian());
+    }
+    random = rng;
+    for(auto &e : emitters) {
+        render(e, out, count);
+    }
+}
+
+size_t generator::generate(int16_t *out, size_t count)
+{
+    if(block.size() < count) {
+        block.resize(count);
+    }
+    generate(block.data(), count);
+
+    // Clip at full scale like the ADC:
+    const float *in = reinterpret_cast<const float*>(block.data());
+    for(size_t i = 0; i < 2 * count; i++) {
+        out[i] = static_cast<int16_t>(std::clamp(in[i], -1.0f, 1.0f) * 32767.0f);
+    }
+    return count;
+}
@@ -0,0 +1,163 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <complex>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "samplesource.h"
+
+// xoshiro256+ (Blackman/Vigna), small, fast and the same sequence on every
+// platform, unlike rand():
+class xoshiro {
+    public:
+    xoshiro(uint64_t seed = 17);
+    void seed(uint64_t seed);
+
+    uint64_t next()
+    {
+        uint64_t result = s[0] + s[3];
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = (s[3] << 45) | (s[3] >> 19);
+        return result;
+    }
+
+    // Uniform in [0, 1):
+    double uniform() { return (next() >> 11) * 0x1.0p-53; }
+
+    // Approximately normal, zero mean and unit variance (sum of the four
+    // 16 bit quarters of one draw, Irwin-Hall):
+    float gaussian()
+    {
+        uint64_t v = next();
+        uint32_t sum = (v & 0xffff) + ((v >> 16) & 0xffff) + ((v >> 32) & 0xffff) + (v >> 48);
+        return (static_cast<float>(sum) - 131070.0f) * (1.7320508f / 65536.0f);
+    }
+
+    private:
+    uint64_t s[4];
+};
+
+// Recursive NCO: a handful of lanes rotate independently by increment *
+// lanes, so the inner loop has no dependency between neighbouring samples
+// and vectorizes. The lanes are restarted from the double precision phase
+// every chunk, which keeps the float recursion from drifting.
+class nco {
+    public:
+    nco();
+    void setFrequency(double frequency, double sampleRate);
+    // out[n] = e^(j phi[n]):
+    void generate(std::complex<float> *out, size_t count);
+
+    private:
+    static constexpr size_t lanes = 8;
+    static constexpr size_t chunk = 256;
+    double phase;
+    double increment;
+};
+
+// Synthetic band for the fake connection and load tests. A scenario is a
+// noise floor plus any number of emitters (carriers, keyed CW, SSB-like
+// noise bursts, BPSK beacons), all derived from one seed, so the same
+// scenario produces the same samples on every machine. Scenario files are
+// line based, frequencies are offsets from the center in Hz, levels in
+// dBFS:
+//
+//   # comment
+//   seed  17
+//   noise -60
+//   tone  210.9375 -20
+//   cw    -225000 -40 22 CQ CQ DE DL1ABC
+//   ssb   -60000 -35 usb
+//   psk   -195000 -45 PLUTO17 BEACON
+class generator : public sampleSource {
+    public:
+    generator(double sampleRate = 576'000.0);
+
+    // An empty path loads the built-in scenario:
+    bool load(const std::string &path);
+    void loadDefault();
+
+    // Fills count interleaved int16 IQ samples, quantized like the ADC:
+    size_t generate(int16_t *out, size_t count);
+
+    size_t read(int16_t *out, size_t count) override { return generate(out, count); }
+
+    // Float version of the same, the int16 one quantizes this:
+    void generate(std::complex<float> *out, size_t count);
+
+    void setSampleRate(double sampleRate);
+    double getSampleRate() override { return sampleRate; }
+    size_t getEmitterCount() { return emitters.size(); }
+    const std::string& getScenario() { return scenario; }
+
+    private:
+    enum kind { TONE, CW, SSB, PSK };
+
+    struct emitter {
+        kind type;
+        double frequency;
+        float amplitude;
+        double wpm;
+        bool lsb;
+        std::string text;
+        nco carrier;
+
+        // Keying (CW elements, PSK bits), one entry per element:
+        std::vector<uint8_t> pattern;
+        size_t position;
+        uint64_t elapsed;
+        uint64_t elementLength;
+
+        // Shaped envelope (CW, SSB bursts) and PSK phase:
+        float envelope;
+        float target;
+        float sign;
+
+        // SSB: band limited noise at the reduced rate, interpolated:
+        std::complex<float> lowpass1;
+        std::complex<float> lowpass2;
+        std::complex<float> value;
+        std::complex<float> delta;
+        float gain;
+        uint64_t burstRemaining;
+    };
+
+    void builtin();
+    bool addEmitter(kind type, double frequency, double level, const std::string &arguments);
+    void prepare(emitter &e);
+    void render(emitter &e, std::complex<float> *out, size_t count);
+    std::vector<uint8_t> morse(const std::string &text);
+    std::vector<uint8_t> bits(const std::string &text);
+
+    double sampleRate;
+    std::string scenario;
+
+    // load() may be called from the GUI while the acquisition thread
+    // generates:
+    std::mutex scenarioMutex;
+    uint64_t seed;
+    float noiseAmplitude;
+    std::vector<emitter> emitters;
+    xoshiro random;
+
+    // Per block scratch, grown on demand:
+    std::vector<std::complex<float>> block;
+    std::vector<std::complex<float>> phasors;
+
+    // CW/SSB envelope smoothing and PSK31 symbol shape. The SSB noise only
+    // needs a few kHz, it is generated at sampleRate / ssbDecimation:
+    float cwAlpha;
+    float burstAlpha;
+    float ssbAlpha;
+    uint64_t ssbDecimation;
+    std::vector<float> pskShape;
+};
+
+#endif
@@ -1,24 +1,37 @@
 #include "gui.h"
+#include <ctime>
 
 gui::gui(
     std::function<bool()> connectCallback,
-    std::function<bool()> fakeConnectCallback,
+    std::function<bool(const std::string&)> fakeConnectCallback,
     std::function<bool()> isConnectedCallback,
-    fftw_complex* fftBuffer,
+    std::function<uint64_t()> overrunCallback,
+    std::function<bool(const std::string&)> playbackCallback,
+    std::function<uint64_t()> publishedCallback,
+    spectrumFft* fourier,
+    spectrumAverager* averager,
+    signalDetector* detector,
+    audio* sound,
+    channelizer* channels,
+    recorder* iqRecorder,
+    playback* player,
+    gapDetector* gaps,
+    transmitter* uplink,
+    beaconTracker* tracker,
+    zoomSpectrum* zoom,
+    deviceControl* control,
+    std::function<void(bool)> channelizedCallback,
+    std::function<void(unsigned)> kernelBuffersCallback,
+    std::function<void(double)> tuneCallback,
     uint64_t *carrier,
-    uint64_t N
-) : waterfallRingBuffer(256),
-    spectrumHistory(100, std::vector<float>(N, 0.0f)),
+    frequencyPlan* plan
+) : plan(plan),
+    N(plan->getN()),
+    // Calculate dynamic range (14 bit ADC of Pluto and log2(N) bits for FFT, for each bit we have 6 dB gain)
+    dynamicRange(static_cast<int>((14.0f+log2f(N))*6)),
     carrier(carrier),
-    N(N)
+    waterfallBuffer(N, 256, static_cast<float>(dynamicRange))
 {
-    // Calculate dynamic range (14 bit ADC of Pluto and log2(N) bits for FFT, for each bit we have 6 dB gain)
-    dynamicRange = static_cast<uint64_t>((14.0f+log2f(N))*6);
-
-    // Initialize waterfallRingBuffer with -1 * dynamicRange
-    for (auto& buffer : waterfallRingBuffer) {
-        buffer.fill(-1 * dynamicRange);
-    }
 
     // Prepare the Gradient:
     max = -58;
@@ -26,15 +39,17 @@ gui::gui(
     dmax = static_cast<double>(max);
     dmin = static_cast<double>(min);
     prepareGradient();
-    historyIndex=0;
 
-    // Generate Frequency Caption for Waterfall:
-    for(int i = 0; i < 4096; i++) {
-        frequencyBins[i] = fft::bucketToFrequency(i, N) / 1'000'000.0;
-    }
+    // Spectrum display reduction, the X axis can be zoomed (wheel) and
+    // panned (middle mouse, left is used by the VFO):
+    reducedGeneration = UINT64_MAX;
+    resetXLimits = true;
+    ImPlot::GetInputMap().Pan = ImGuiMouseButton_Middle;
 
-    filterStart = (fft::bucketToFrequency(4096/2, N) / 1'000'000.0) - (filterWidth / 1'000'000.0)/2.0;
-    filterEnd = (fft::bucketToFrequency(4096/2, N) / 1'000'000.0) + (filterWidth / 1'000'000.0)/2.0;
+    filterWidth = 3'000.0;
+    filterStart = (plan->bucketToFrequency(N/2) / 1'000'000.0) - (filterWidth / 1'000'000.0)/2.0;
+    filterEnd = (plan->bucketToFrequency(N/2) / 1'000'000.0) + (filterWidth / 1'000'000.0)/2.0;
+    fftSizeIndex = static_cast<int>(log2(static_cast<double>(N) / frequencyPlan::minN));
 
     // Initialize the OpenGL Shaders
     initWaterfall();
@@ -43,14 +58,95 @@ gui::gui(
     this->connectCallback = connectCallback;
     this->fakeConnectCallback = fakeConnectCallback;
     this->isConnectedCallback = isConnectedCallback;
-    this->fftBuffer = fftBuffer;
+    this->overrunCallback = overrunCallback;
+    this->playbackCallback = playbackCallback;
+    this->publishedCallback = publishedCallback;
+    this->fourier = fourier;
+    this->averager = averager;
+    this->detector = detector;
+    this->sound = sound;
+    this->channels = channels;
+    this->iqRecorder = iqRecorder;
+    this->player = player;
+    playbackPath[0] = '\0';
+    scenarioPath[0] = '\0';
+    metricsEnabled = metrics::isEnabled();
+    std::snprintf(metricsPath, sizeof(metricsPath), "pluto17-metrics.json");
+    metricsFormat = metrics::JSON;
+    metricsInterval = 10.0f;
+    throughputTime = 0.0;
+    throughputSamples = 0;
+    throughput = 0.0;
+    this->channelizedCallback = channelizedCallback;
+    channelized = false;
+    this->gaps = gaps;
+    this->kernelBuffersCallback = kernelBuffersCallback;
+    kernelBuffers = static_cast<int>(gaps->getKernelBuffers());
+
+    // Transmitter:
+    this->uplink = uplink;
+    txOffset = static_cast<float>(uplink->getFrequency() / 1'000.0);
+    txPower = static_cast<float>(uplink->getPower());
+    micGain = uplink->getMicGain();
+    txSideband = uplink->getSideband();
+    micLevel = 0.0f;
+    this->tracker = tracker;
+
+    // Band center, retuned through the device control queue:
+    this->control = control;
+    this->tuneCallback = tuneCallback;
+    bandCenter = plan->getCenterFrequency() / 1'000'000.0;
+
+    // Zoom, factor and size are powers of two from their minimum:
+    this->zoom = zoom;
+    zoomFactorIndex = static_cast<int>(log2(static_cast<double>(zoom->getFactor()) / zoomSpectrum::minFactor));
+    zoomSizeIndex = static_cast<int>(log2(static_cast<double>(zoom->getN()) / zoomSpectrum::minN));
+    zoomGeneration = 0;
+    zoomCenter = 0.0;
+    zoomBinWidth = zoom->getBinWidth();
+    zoomWaterfall = waterfall(zoom->getN(), 256, static_cast<float>(dynamicRange));
+
+    // Window Settings:
+    windowType = fourier->getWindow().getType();
+    kaiserBeta = static_cast<float>(fourier->getWindow().getBeta());
+
+    // Averaging Settings:
+    averagingMode = averager->getMode();
+    averagingDepth = static_cast<int>(averager->getDepth());
+    holdDecay = averager->getDecay();
+
+    // Detector Settings, the bandplan segments are counted DSP side:
+    for(const auto& segment : bandplan) {
+        detector->addSegment(segment.startFreq, segment.endFreq, segment.label);
+    }
+    showSignals = true;
+    detectorThreshold = detector->getThreshold();
+
+    // Audio Settings:
+    audioLatency = static_cast<float>(sound->getLatency() * 1000.0);
 
     connected = false;
+}
 
-    filterWidth = 3'000.0;
+gui::~gui()
+{
+    // The audio thread must not feed a recorder that is gone:
+    for(auto &r : vfoRecorders) {
+        channels->setSink(r.first, nullptr);
+    }
 }
 
 void gui::render() {
+    // Follow FFT size changes (the DSP side has already switched):
+    if(plan->getN() != N) {
+        resize();
+    }
+
+    // One new waterfall row per frame (the zoom has its own):
+    if(connected) {
+        updateWaterfall();
+    }
+
     // Get the size of the main window
     ImVec2 windowSize = ImGui::GetIO().DisplaySize;
     renderRX(windowSize.x*0.2, windowSize.y, 0.0f);
@@ -67,15 +163,47 @@ void gui::renderRX(float width, float height, float xoffset) {
         if(ImGui::SliderFloat(
             "QRG",
             &qrg,
-            fft::bucketToFrequency(0,N)/1'000'000.0,
-            fft::bucketToFrequency(N,N)/1'000'000.0,
+            plan->bucketToFrequency(0)/1'000'000.0,
+            plan->bucketToFrequency(N)/1'000'000.0,
             "%.6f MHz")
         ){
             renderVFOtrigger = true;
-            zoomOffset = fft::frequencyToBucket(qrg*1'000'000.0, N);
+            zoomOffset = static_cast<int>(plan->frequencyToBucket(qrg*1'000'000.0));
+        }
+
+        if(ImGui::Checkbox("Channelized (multiple VFOs)", &channelized)) {
+            channelizedCallback(channelized);
+        }
+        if(channelized) {
+            renderVfos();
         }
     }
 
+    if (ImGui::CollapsingHeader("Tuning")) {
+        renderTuning();
+    }
+
+    if (ImGui::CollapsingHeader("Beacon Lock")) {
+        renderTracker();
+    }
+
+    if (ImGui::CollapsingHeader("Audio", ImGuiTreeNodeFlags_DefaultOpen)) {
+        if(ImGui::SliderFloat("Latency", &audioLatency, 10.0f, audio::maxLatency * 1000.0f, "%.0f ms")) {
+            sound->setLatency(audioLatency / 1000.0);
+        }
+        ImGui::Text("Buffered: %.0f ms", sound->getBufferedLatency() * 1000.0);
+        ImGui::Text("Underruns: %llu", static_cast<unsigned long long>(sound->getUnderruns()));
+        ImGui::Text("Overruns: %llu", static_cast<unsigned long long>(sound->getOverruns()));
+    }
+
+    if (ImGui::CollapsingHeader("Playback")) {
+        renderPlayback();
+    }
+
+    if (ImGui::CollapsingHeader("Recorder", ImGuiTreeNodeFlags_DefaultOpen)) {
+        renderRecorder();
+    }
+
     if (ImGui::CollapsingHeader("Adalm Pluto Settings", ImGuiTreeNodeFlags_DefaultOpen)) {
         if(isConnectedCallback()) {
             if (ImGui::Button("Disconnect")) {
@@ -93,12 +221,18 @@ void gui::renderRX(float width, float height, float xoffset) {
             }
         }
 
+        // Empty scenario: built-in synthetic band
+        ImGui::InputText("Scenario", scenarioPath, sizeof(scenarioPath));
         if (ImGui::Button("Fake Connect")) {
-            if(fakeConnectCallback()){
+            if(fakeConnectCallback(scenarioPath)){
                 std::cout << "Connected to Fake" << std::endl;
                 connected = true;
             }
         }
+
+        // Blocks dropped because a consumer fell behind the acquisition:
+        ImGui::Text("Overruns: %llu", static_cast<unsigned long long>(overrunCallback()));
+        renderGaps();
     }
 
     if (ImGui::CollapsingHeader("Waterfall Settings", ImGuiTreeNodeFlags_DefaultOpen))
@@ -111,38 +245,442 @@ void gui::renderRX(float width, float height, float xoffset) {
         }
     }
 
-    if (ImGui::CollapsingHeader("Zoom", ImGuiTreeNodeFlags_DefaultOpen))
+    if (ImGui::CollapsingHeader("Spectrum Settings", ImGuiTreeNodeFlags_DefaultOpen))
     {
-        if(connected==true) {
-            ImPlot::SetNextAxesLimits(
-                fft::bucketToFrequency(zoomOffset, N) / 1'000'000.0,
-                fft::bucketToFrequency(zoomOffset+127, N) / 1'000'000.0,
-                0,
-                127,
-                ImPlotCond_Always
-            );
-            if(ImPlot::BeginPlot("", ImVec2(-1,128))) {
-                ImPlot::SetupAxis(ImAxis_X1, "", ImPlotAxisFlags_NoTickMarks | ImPlotAxisFlags_NoTickLabels);
-                ImPlot::SetupAxis(ImAxis_Y1, "", ImPlotAxisFlags_NoTickMarks | ImPlotAxisFlags_NoTickLabels);
-                ImPlot::PlotImage(
-                    "", // Waterfall
-                    static_cast<intptr_t>(waterfallTexture),
-                    ImVec2(fft::bucketToFrequency(0, N) / 1'000'000.0, 128),
-                    ImVec2(fft::bucketToFrequency(4095, N) / 1'000'000.0, 0)
-                );
-                double x1 = (fft::bucketToFrequency(zoomOffset+63, N) - filterWidth/2.0) / 1'000'000.0;
-                double x2 = (fft::bucketToFrequency(zoomOffset+63, N) + filterWidth/2.0) / 1'000'000.0;
-                double y1 = 0;
-                double y2 = 128;
-                ImPlot::DragRect(0, &x1, &y1, &x2, &y2, ImVec4(0.0, 0.78, 0.0, 0.75), ImPlotDragToolFlags_NoInputs);
-                ImPlot::EndPlot();
+        // FFT size from 1k to 64k, switched live by the DSP side:
+        const char* fftSizes[] = {"1024", "2048", "4096", "8192", "16384", "32768", "65536"};
+        if(ImGui::Combo("FFT Size", &fftSizeIndex, fftSizes, IM_ARRAYSIZE(fftSizes))) {
+            plan->setN(frequencyPlan::minN << fftSizeIndex);
+        }
+        ImGui::Text("Resolution: %.3f Hz, %.1f ms/frame", plan->getBinWidth(), 1000.0 * N / plan->getSampleRate());
+
+        const char* windowNames[windowFunction::count];
+        for(int i = 0; i < windowFunction::count; i++) {
+            windowNames[i] = windowFunction::name(static_cast<windowFunction::type>(i));
+        }
+        bool changed = ImGui::Combo("Window", &windowType, windowNames, windowFunction::count);
+        if(windowType == windowFunction::KAISER) {
+            changed |= ImGui::SliderFloat("Beta", &kaiserBeta, 0.0f, 20.0f, "%.1f");
+        }
+        if(changed) {
+            fourier->setWindow(static_cast<windowFunction::type>(windowType), kaiserBeta);
+        }
+
+        // The dB readings are normalized by the coherent gain, the noise
+        // floor per bin scales with the noise equivalent bandwidth:
+        double enbw = fourier->getWindow().getNoiseEquivalentBandwidth();
+        ImGui::Text("Coherent Gain: %.2f dB", 20.0 * log10(fourier->getWindow().getCoherentGain()));
+        ImGui::Text("ENBW: %.2f bins (%.1f Hz)", enbw, enbw * (plan->bucketToFrequency(1) - plan->bucketToFrequency(0)));
+
+        const char* averagingNames[spectrumAverager::count];
+        for(int i = 0; i < spectrumAverager::count; i++) {
+            averagingNames[i] = spectrumAverager::name(static_cast<spectrumAverager::mode>(i));
+        }
+        if(ImGui::Combo("Averaging", &averagingMode, averagingNames, spectrumAverager::count)) {
+            averager->setMode(static_cast<spectrumAverager::mode>(averagingMode));
+        }
+        if(averagingMode == spectrumAverager::PEAK_HOLD || averagingMode == spectrumAverager::MIN_HOLD) {
+            if(ImGui::SliderFloat("Decay", &holdDecay, 0.0f, 2.0f, "%.2f dB")) {
+                averager->setDecay(holdDecay);
+            }
+        } else if(ImGui::SliderInt("Depth", &averagingDepth, 1, 1000)) {
+            averager->setDepth(static_cast<unsigned>(averagingDepth));
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Signal Detector", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::Checkbox("Show Signals", &showSignals);
+        if(ImGui::SliderFloat("Threshold", &detectorThreshold, 3.0f, 30.0f, "%.1f dB")) {
+            detector->setThreshold(detectorThreshold);
+        }
+
+        int active = 0;
+        for(const auto& signal : detector->getSignals()) {
+            active += signal.active && signal.confirmed;
+        }
+        ImGui::Text("Active Signals: %d", active);
+
+        // Occupancy now / since start per bandplan segment:
+        for(const auto& segment : detector->getSegments()) {
+            if(segment.lastActivity < 0) {
+                ImGui::Text("%-4s %5.1f %% %5.1f %%", segment.label.c_str(), segment.current * 100.0, segment.getOccupancy() * 100.0);
+            } else {
+                double idle = detector->getTime() - segment.lastActivity;
+                ImGui::Text("%-4s %5.1f %% %5.1f %% (%.0f s ago)", segment.label.c_str(), segment.current * 100.0, segment.getOccupancy() * 100.0, idle);
             }
         }
+        if(ImGui::Button("Reset Statistics")) {
+            detector->resetStatistics();
+        }
+
+        // Most recent ended signals:
+        for(size_t i = 0; i < std::min<size_t>(detector->getHistoryCount(), 5); i++) {
+            const auto& signal = detector->getHistory(i);
+            ImGui::Text("%.6f MHz %4.1f dB %5.1f s", signal.frequency / 1'000'000.0, signal.peakSnr, signal.stop - signal.start);
+        }
+    }
+
+    // The zoom engine only runs while its panel is open:
+    bool zoomOpen = ImGui::CollapsingHeader("Zoom", ImGuiTreeNodeFlags_DefaultOpen);
+    zoom->setEnabled(zoomOpen && connected);
+    if (zoomOpen && connected) {
+        renderZoom();
     }
 
     ImGui::End();
 }
 
+// VFOs of the channelizer, new ones start at the frequency of the main VFO
+void gui::renderVfos()
+{
+    vfos = channels->getVfos();
+
+    if(ImGui::Button("Add VFO")) {
+        double center = (filterStart + filterEnd) / 2.0 * 1'000'000.0;
+        channels->addVfo(plan->toBaseband(center));
+    }
+
+    const char* sidebands[] = { "USB", "LSB" };
+    for(auto &v : vfos) {
+        ImGui::PushID(v.id);
+        double mhz = (plan->getCenterFrequency() + v.frequency) / 1'000'000.0;
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.45f);
+        if(ImGui::InputDouble("##qrg", &mhz, 0.0001, 0.001, "%.6f")) {
+            channels->setFrequency(v.id, plan->toBaseband(mhz * 1'000'000.0));
+        }
+        ImGui::SameLine();
+        int side = v.side;
+        ImGui::SetNextItemWidth(60.0f);
+        if(ImGui::Combo("##side", &side, sidebands, 2)) {
+            channels->setSideband(v.id, static_cast<ssb::sideband>(side));
+        }
+        ImGui::SameLine();
+        bool monitored = v.monitored;
+        if(ImGui::Checkbox("##monitor", &monitored)) {
+            channels->setMonitored(v.id, monitored);
+        }
+        ImGui::SameLine();
+        bool recording = vfoRecorders.count(v.id) > 0;
+        if(ImGui::Checkbox("Rec", &recording)) {
+            recordVfo(v, recording);
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("X")) {
+            recordVfo(v, false);
+            channels->removeVfo(v.id);
+        }
+        auto wav = vfoRecorders.find(v.id);
+        if(wav != vfoRecorders.end()) {
+            ImGui::Text("Recording %.1f s, dropped %llu samples",
+                static_cast<double>(wav->second->getSamples()) / ssb::audioRate,
+                static_cast<unsigned long long>(wav->second->getDroppedSamples()));
+        }
+        ImGui::PopID();
+    }
+}
+
+// Records the VFO's own audio to a WAV file named after its frequency, the
+// sink only copies on the audio thread, the recorder writes on its own
+void gui::recordVfo(const channelizer::vfoInfo &v, bool on)
+{
+    auto existing = vfoRecorders.find(v.id);
+    if(!on) {
+        if(existing != vfoRecorders.end()) {
+            channels->setSink(v.id, nullptr);
+            vfoRecorders.erase(existing);
+        }
+        return;
+    }
+    if(existing != vfoRecorders.end()) {
+        return;
+    }
+
+    std::time_t now = std::time(nullptr);
+    char time[32];
+    std::strftime(time, sizeof(time), "%Y%m%d-%H%M%S", std::localtime(&now));
+    double hz = plan->getCenterFrequency() + v.frequency;
+    char name[96];
+    std::snprintf(name, sizeof(name), "pluto17-vfo%d-%.0f-%s.wav", v.id, hz, time);
+
+    auto wav = std::make_unique<wavRecorder>(ssb::audioRate);
+    if(!wav->start(name)) {
+        return;
+    }
+    wavRecorder *sink = wav.get();
+    channels->setSink(v.id, [sink](const float *samples, size_t count) { sink->write(samples, count); });
+    vfoRecorders[v.id] = std::move(wav);
+}
+
+// Kernel buffering (applied on the next connect) and samples the hardware
+// had to drop, with the time of each gap
+void gui::renderGaps()
+{
+    if(ImGui::SliderInt("Kernel Buffers", &kernelBuffers, 1, 64)) {
+        kernelBuffersCallback(static_cast<unsigned>(kernelBuffers));
+    }
+    ImGui::Text("Lag: %.1f ms", gaps->getLag() * 1'000.0);
+    ImGui::Text("Dropped: %llu samples in %llu gaps",
+        static_cast<unsigned long long>(gaps->getDroppedSamples()),
+        static_cast<unsigned long long>(gaps->getGaps()));
+
+    auto events = gaps->getEvents();
+    for(size_t i = events.size() > 5 ? events.size() - 5 : 0; i < events.size(); i++) {
+        char time[32];
+        std::time_t t = std::chrono::system_clock::to_time_t(events[i].time);
+        std::strftime(time, sizeof(time), "%H:%M:%S", std::localtime(&t));
+        ImGui::Text("%s  %8.1f s  %llu samples", time, events[i].streamTime, static_cast<unsigned long long>(events[i].samples));
+    }
+}
+
+// SSB uplink, the TX thread does the actual work
+void gui::renderTransmitter()
+{
+    if(!uplink->isRunning()) {
+        ImGui::Text("Connect the Pluto to transmit");
+        return;
+    }
+
+    const char* stateNames[] = {"RX", "Prefill", "TX", "Tail"};
+    transmitter::state state = uplink->getState();
+    bool keyed = state == transmitter::KEYED || state == transmitter::TAIL;
+    if(keyed) {
+        ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.8f, 0.1f, 0.1f, 1.0f));
+    }
+    if(ImGui::Button(uplink->getPtt() ? "Release PTT" : "PTT", ImVec2(-1, 40))) {
+        uplink->setPtt(!uplink->getPtt());
+    }
+    if(keyed) {
+        ImGui::PopStyleColor();
+    }
+    ImGui::Text("State: %s", stateNames[state]);
+
+    const char* sidebands[] = {"USB", "LSB"};
+    if(ImGui::Combo("Sideband", &txSideband, sidebands, IM_ARRAYSIZE(sidebands))) {
+        uplink->setSideband(static_cast<ssb::sideband>(txSideband));
+    }
+    if(ImGui::SliderFloat("Offset", &txOffset, -45.0f, 45.0f, "%.3f kHz")) {
+        uplink->setFrequency(txOffset * 1'000.0);
+    }
+    if(ImGui::SliderFloat("Power", &txPower, static_cast<float>(transmitter::minPower), 0.0f, "%.1f dB")) {
+        uplink->setPower(txPower);
+    }
+    if(ImGui::SliderFloat("Mic Gain", &micGain, 0.0f, 4.0f, "%.2f")) {
+        uplink->setMicGain(micGain);
+    }
+
+    // Peak hold with a slow decay, the meter is read once per frame:
+    micLevel = std::max(uplink->getMicLevel(), micLevel * 0.95f);
+    ImGui::ProgressBar(std::min(micLevel, 1.0f), ImVec2(-1, 0), micLevel >= 1.0f ? "Clipping" : "");
+
+    ImGui::Text("Blocks: %llu", static_cast<unsigned long long>(uplink->getPushedBlocks()));
+    ImGui::Text("DAC Underruns: %llu", static_cast<unsigned long long>(uplink->getUnderruns()));
+    ImGui::Text("Mic Underruns: %llu", static_cast<unsigned long long>(uplink->getMicUnderruns()));
+}
+
+// Round trip via PN bursts, measuring keys the transmitter
+void gui::renderLatency()
+{
+    latencyMeter *meter = uplink->getLatencyMeter();
+    if(!uplink->isRunning() || meter == nullptr) {
+        ImGui::Text("Connect the Pluto to measure");
+        return;
+    }
+
+    bool measuring = meter->isEnabled();
+    if(ImGui::Checkbox("Measure", &measuring)) {
+        meter->setEnabled(measuring);
+        uplink->setPtt(measuring);
+    }
+    float range = static_cast<float>(meter->getSearchRange());
+    if(ImGui::SliderFloat("Search", &range, 10.0f, 2'000.0f, "+-%.0f Hz")) {
+        meter->setSearchRange(range);
+    }
+
+    ImGui::Text("Delay: %.3f ms (%.1f samples)", meter->getDelay() * 1'000.0, meter->getDelaySamples());
+    ImGui::Text("Smoothed: %.3f ms", meter->getSmoothedDelay() * 1'000.0);
+    if(meter->getReference() != 0.0) {
+        ImGui::Text("Round Trip: %.3f ms", (meter->getSmoothedDelay() - meter->getReference()) * 1'000.0);
+    }
+    ImGui::Text("Frequency Offset: %.1f Hz", meter->getFrequencyOffset());
+    ImGui::Text("Quality: %.1f (%llu found, %llu missed)", meter->getQuality(),
+        static_cast<unsigned long long>(meter->getMeasurements()),
+        static_cast<unsigned long long>(meter->getMisses()));
+
+    // A local loopback (TX into RX without the satellite) gives our own
+    // processing latency, which is then taken off the round trip:
+    if(ImGui::Button("Set Loopback Reference")) {
+        meter->setReference();
+    }
+    ImGui::SameLine();
+    if(ImGui::Button("Clear")) {
+        meter->clearReference();
+    }
+}
+
+// LNB drift correction from the center beacon, runs on its own thread
+void gui::renderTracker()
+{
+    bool enabled = tracker->isEnabled();
+    if(ImGui::Checkbox("Lock to Beacon", &enabled)) {
+        tracker->setEnabled(enabled);
+    }
+    float range = static_cast<float>(tracker->getSearchRange());
+    if(ImGui::SliderFloat("Search", &range, 100.0f, 2'500.0f, "+-%.0f Hz")) {
+        tracker->setSearchRange(range);
+    }
+    bool txCorrected = tracker->isTxCorrected();
+    if(ImGui::Checkbox("Correct TX (Pluto reference drift)", &txCorrected)) {
+        tracker->setTxCorrected(txCorrected);
+    }
+
+    const char* stateNames[] = {"Off", "Searching", "Locked", "Beacon out of band"};
+    ImGui::Text("State: %s", stateNames[tracker->getState()]);
+    ImGui::Text("Correction: %.2f Hz", plan->getCorrection());
+    ImGui::Text("Last Estimate: %.2f Hz", tracker->getRawOffset());
+    ImGui::Text("Coherence: %.2f", tracker->getCoherence());
+    ImGui::Text("Locks: %llu", static_cast<unsigned long long>(tracker->getLocks()));
+}
+
+// Band center of the Pluto. Steps hop by half the span, clicks faster than
+// the LOs retune are merged by the control thread into one retune.
+void gui::renderTuning()
+{
+    if(!control->isOpen()) {
+        ImGui::Text("Connect the Pluto to tune");
+        return;
+    }
+
+    double step = plan->getSampleRate() / 2.0 / 1'000'000.0;
+    if(ImGui::InputDouble("Center", &bandCenter, step, step, "%.6f MHz", ImGuiInputTextFlags_EnterReturnsTrue)) {
+        tuneCallback(bandCenter * 1'000'000.0);
+    }
+    if(ImGui::Button("Beacon")) {
+        bandCenter = beaconTracker::beaconFrequency / 1'000'000.0;
+        tuneCallback(beaconTracker::beaconFrequency);
+    }
+    ImGui::SameLine();
+    bool fastlock = control->getFastlock();
+    if(ImGui::Checkbox("Fastlock", &fastlock)) {
+        control->setFastlock(fastlock);
+    }
+
+    // Percentiles are in the "retune" row of the statistics:
+    ImGui::Text("Retunes: %llu (%llu requests merged)",
+        static_cast<unsigned long long>(control->getRetunes()),
+        static_cast<unsigned long long>(control->getBatched()));
+    ImGui::Text("LO Write: %.2f ms (max %.2f ms)", control->getLastLoWrite() * 1'000.0, control->getMaxLoWrite() * 1'000.0);
+}
+
+// Per stage timing and the pipeline counters, optionally dumped to a file
+void gui::renderMetrics()
+{
+    if(ImGui::Checkbox("Enabled", &metricsEnabled)) {
+        metrics::setEnabled(metricsEnabled);
+    }
+
+    if(ImGui::BeginTable("Stages", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Stage");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("p50 us");
+        ImGui::TableSetupColumn("p99 us");
+        ImGui::TableSetupColumn("Max us");
+        ImGui::TableHeadersRow();
+        for(const histogram *h : metrics::instance().getHistograms()) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", h->name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(h->getCount()));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", h->getPercentile(0.5) / 1'000.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", h->getPercentile(0.99) / 1'000.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", h->getMax() / 1'000.0);
+        }
+        ImGui::EndTable();
+    }
+
+    for(const counter *c : metrics::instance().getCounters()) {
+        ImGui::Text("%s: %llu", c->name.c_str(), static_cast<unsigned long long>(c->get()));
+    }
+    for(const auto &p : metrics::instance().getProbes()) {
+        ImGui::Text("%s: %g", p.name.c_str(), p.value);
+    }
+
+    ImGui::InputText("Dump File", metricsPath, sizeof(metricsPath));
+    const char* formats[] = {"JSON", "Prometheus"};
+    ImGui::Combo("Format", &metricsFormat, formats, IM_ARRAYSIZE(formats));
+    ImGui::SliderFloat("Interval", &metricsInterval, 1.0f, 60.0f, "%.0f s");
+    if(metrics::instance().isDumping()) {
+        if(ImGui::Button("Stop Dump")) {
+            metrics::instance().stopDump();
+        }
+    } else if(ImGui::Button("Start Dump")) {
+        metrics::instance().startDump(metricsPath, metricsInterval, static_cast<metrics::format>(metricsFormat));
+    }
+}
+
+// IQ file playback instead of the Pluto (SigMF, .cs16 or .cf32)
+void gui::renderPlayback()
+{
+    ImGui::InputText("File", playbackPath, sizeof(playbackPath));
+    if(ImGui::Button("Open")) {
+        if(playbackCallback(playbackPath)) {
+            connected = true;
+        }
+    }
+
+    if(player->isOpen()) {
+        bool loop = player->getLoop();
+        if(ImGui::Checkbox("Loop", &loop)) {
+            player->setLoop(loop);
+        }
+        ImGui::SameLine();
+        bool realtime = player->getRealtime();
+        if(ImGui::Checkbox("Real Time", &realtime)) {
+            player->setRealtime(realtime);
+        }
+
+        float position = static_cast<float>(player->getPosition());
+        if(ImGui::SliderFloat("Position", &position, 0.0f, static_cast<float>(player->getLength()), "%.1f s")) {
+            player->seek(position);
+        }
+    }
+
+    // Achieved sample rate, unpaced this is the throughput of the pipeline:
+    double now = ImGui::GetTime();
+    if(now - throughputTime >= 1.0) {
+        uint64_t published = publishedCallback();
+        throughput = (published - throughputSamples) / (now - throughputTime);
+        throughputSamples = published;
+        throughputTime = now;
+    }
+    ImGui::Text("Throughput: %.2f MS/s", throughput / 1'000'000.0);
+}
+
+// Raw IQ recording to SigMF files named after the start time
+void gui::renderRecorder()
+{
+    if(iqRecorder->isRecording()) {
+        if(ImGui::Button("Stop Recording")) {
+            iqRecorder->stop();
+        }
+        ImGui::Text("%s", iqRecorder->getBasename().c_str());
+    } else if(ImGui::Button("Start Recording")) {
+        std::time_t now = std::time(nullptr);
+        char name[64];
+        std::strftime(name, sizeof(name), "pluto17-%Y%m%d-%H%M%S", std::localtime(&now));
+        iqRecorder->start(name);
+    }
+
+    double seconds = static_cast<double>(iqRecorder->getSamples()) / plan->getSampleRate();
+    ImGui::Text("Length: %.1f s (%.1f MB)", seconds, iqRecorder->getSamples() * 4.0 / 1'000'000.0);
+    ImGui::Text("Dropped: %llu samples", static_cast<unsigned long long>(iqRecorder->getDroppedSamples()));
+    ImGui::Text("Stalls: %llu (max %.0f ms)", static_cast<unsigned long long>(iqRecorder->getStalls()), iqRecorder->getMaxLatency() * 1000.0);
+    ImGui::Text("Ring: %zu / %zu", iqRecorder->getHighWater(), iqRecorder->getRingCapacity());
+}
+
 void gui::renderMain(float width, float height, float xoffset) {
     ImGui::SetNextWindowPos(ImVec2(xoffset, 0), ImGuiCond_Always);
     ImGui::SetNextWindowSize(ImVec2(width,height), ImGuiCond_Always);
@@ -162,62 +700,25 @@ void gui::renderMain(float width, float height, float xoffset) {
         auto bandplanSize = ImVec2(areaSize.x, 8);
         auto waterfallSize = ImVec2(areaSize.x, areaSize.y-220);
 
-        // Prepare FFT data:
-        std::array<int,4096> data;
-        std::vector<float> spectrumData(N);
-        for(int n = 0; n < N; n++) {
-
-            // Normalization:
-            double i = fftBuffer[n][0] / static_cast<double>(N); 
-            double q = fftBuffer[n][1] / static_cast<double>(N); 
-
-            // Calculate the absolute value:
-            double f = sqrt(i*i + q*q);
-
-            // Calculate the power in dBFS:
-            double p = 20.0 * log10(f);
-
-            //if (n>2500 && n<2510) {
-            //    p = 0.0;
-            //} else {
-            //    p = -120.0;
-            //}
-            
-            data[n] = static_cast<int>(p);
-            spectrumData[n] = static_cast<float>(p);
-        }
-
-        // Average Spectrogram Data:
-        // Add current spectrum data to history
-        spectrumHistory[historyIndex] = spectrumData;
-        historyIndex = (historyIndex + 1) % 100;
-
-        // Calculate the average spectrum data
-        std::vector<float> averagedSpectrumData(N, 0.0f);
-        for (int i = 0; i < N; ++i) {
-            for (int j = 0; j < 100; ++j) {
-            averagedSpectrumData[i] += spectrumHistory[j][i];
-            }
-            averagedSpectrumData[i] /= 100.0f;
-        }
-
         ImPlotSubplotFlags flags = ImPlotSubplotFlags_LinkAllX;
         float rowRatios[] = {8,1,8};
         if(ImPlot::BeginSubplots("", 3, 1, areaSize, flags, rowRatios)) { // Plots
 
             // Setup Spectrogram Plot:
-            ImPlot::SetNextAxesLimits(fft::bucketToFrequency(0, N) / 1'000'000.0, fft::bucketToFrequency(4095, N) / 1'000'000.0, min, max, ImPlotCond_Always);
+            ImPlot::SetNextAxisLimits(ImAxis_X1, plan->bucketToFrequency(0) / 1'000'000.0, plan->bucketToFrequency(N-1) / 1'000'000.0, xLimitsCondition());
+            ImPlot::SetNextAxisLimits(ImAxis_Y1, min, max, ImPlotCond_Always);
             if (ImPlot::BeginPlot("")) { // Spectrum
                 ImPlot::SetupAxisFormat(ImAxis_Y1, "%g dB");
                 ImPlot::SetupAxisFormat(ImAxis_X1, "%.3f MHz");
                 ImPlot::SetupAxis(ImAxis_X1, "", ImPlotAxisFlags_Opposite);
-                ImPlot::PlotLine("Spectrum", frequencyBins.data(), averagedSpectrumData.data(), 4096);
+                plotSpectrum();
                 dragVFO();
                 ImPlot::EndPlot();
             }
 
             // Setup Bandplan Plot:
-            ImPlot::SetNextAxesLimits(fft::bucketToFrequency(0, N) / 1'000'000.0, fft::bucketToFrequency(4095, N) / 1'000'000.0, 0, 10, ImPlotCond_Always);
+            ImPlot::SetNextAxisLimits(ImAxis_X1, plan->bucketToFrequency(0) / 1'000'000.0, plan->bucketToFrequency(N-1) / 1'000'000.0, xLimitsCondition());
+            ImPlot::SetNextAxisLimits(ImAxis_Y1, 0, 10, ImPlotCond_Always);
             if (ImPlot::BeginPlot("")) { // Spectrum
                 ImPlot::SetupAxis(ImAxis_X1, "", ImPlotAxisFlags_NoTickMarks | ImPlotAxisFlags_NoTickLabels);
                 ImPlot::SetupAxis(ImAxis_Y1, "", ImPlotAxisFlags_NoTickMarks | ImPlotAxisFlags_NoTickLabels);
@@ -231,53 +732,32 @@ void gui::renderMain(float width, float height, float xoffset) {
                     ImPlot::DragRect(0, &x1, &y1, &x2, &y2, segment.color, ImPlotDragToolFlags_NoInputs);
                     ImPlot::PlotText(segment.label, x1+(x2-x1)/2, y2-(y2-y1)/2.0); 
                 }
+
+                // Occupancy of the last frame as a bar under each segment:
+                for (const auto& segment : detector->getSegments()) {
+                    double x1 = segment.start / 1'000'000.0;
+                    double x2 = x1 + (segment.end - segment.start) * segment.current / 1'000'000.0;
+                    double y1 = 0;
+                    double y2 = 2;
+                    ImPlot::DragRect(1, &x1, &y1, &x2, &y2, ImVec4(1.0f, 1.0f, 0.0f, 0.8f), ImPlotDragToolFlags_NoInputs);
+                }
                 
                 ImPlot::EndPlot();
             }
 
             // Setup Waterfall Plot:
-            ImPlot::SetNextAxesLimits(fft::bucketToFrequency(0, N) / 1'000'000.0, fft::bucketToFrequency(4095, N) / 1'000'000.0, 0, 255, ImPlotCond_Always);
+            ImPlot::SetNextAxisLimits(ImAxis_X1, plan->bucketToFrequency(0) / 1'000'000.0, plan->bucketToFrequency(N-1) / 1'000'000.0, xLimitsCondition());
+            ImPlot::SetNextAxisLimits(ImAxis_Y1, 0, 255, ImPlotCond_Always);
             if (ImPlot::BeginPlot("")) { // Waterfall
                 // Setup Axis Format:
                 ImPlot::SetupAxisFormat(ImAxis_X1, "%.3f MHz");
                 ImPlot::SetupAxis(ImAxis_Y1, "Time", ImPlotAxisFlags_NoTickLabels);
 
-                // Add new data to the ring buffer:
-                waterfallRingBuffer[waterfallIndex] = data;
-                waterfallIndex = (waterfallIndex + 1) % waterfallRingBuffer.size();
-
-                // Create a texture from the ring buffer
-                std::vector<u_int8_t> waterfallTextureData(N * 256 * 3);
-                for (int i = 0; i < 256; ++i) {
-                    for (int j = 0; j < N; ++j) {
-                        int index = ((waterfallIndex + i) % 256) * N + j;
-                        int value = waterfallRingBuffer[index / N][index % N];
-                        ImVec4 color = gradient[value];
-                        waterfallTextureData[(i * N + j) * 3 + 0] = static_cast<u_int8_t>(color.x * 255); // Red
-                        waterfallTextureData[(i * N + j) * 3 + 1] = static_cast<u_int8_t>(color.y * 255); // Green
-                        waterfallTextureData[(i * N + j) * 3 + 2] = static_cast<u_int8_t>(color.z * 255); // Blue
-                    }
-                }
-
-                // Update texture data
-                glBindTexture(GL_TEXTURE_2D, waterfallTexture);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, N, 256, 0, GL_RGB, GL_UNSIGNED_BYTE, waterfallTextureData.data());
-                glGenerateMipmap(GL_TEXTURE_2D);
-
-                // Use the shader program
-                glUseProgram(waterfallShaderProgram);
-
-                // Bind the texture to the shader
-                glActiveTexture(GL_TEXTURE1); // Use texture unit 1
-                glBindTexture(GL_TEXTURE_2D, waterfallTexture);
-                glUniform1i(glGetUniformLocation(waterfallShaderProgram, "texture2"), 1);
-
-
-                ImPlot::PlotImage(
-                    "", // Waterfall
-                    static_cast<intptr_t>(waterfallTexture),
-                    ImVec2(fft::bucketToFrequency(0, N) / 1'000'000.0, 255),
-                    ImVec2(fft::bucketToFrequency(4095, N) / 1'000'000.0, 0)
+                plotWaterfall(
+                    waterfallTexture,
+                    waterfallBuffer,
+                    ImPlotPoint(plan->bucketToFrequency(0) / 1'000'000.0, 255),
+                    ImPlotPoint(plan->bucketToFrequency(N-1) / 1'000'000.0, 0)
                 );
 
                 dragVFO();
@@ -285,16 +765,88 @@ void gui::renderMain(float width, float height, float xoffset) {
                 ImPlot::EndPlot();
             }
             ImPlot::EndSubplots();
+            resetXLimits = false;
         } 
     }
     ImGui::End();
 }
 
+// Draws the averaged spectrum as min/max envelope, one column per pixel
+void gui::plotSpectrum()
+{
+    // Rebuild the pyramid only when there is a new averaged spectrum:
+    if(averager->getGeneration() != reducedGeneration) {
+        reducer.build(averager->getAverage(), N);
+        reducedGeneration = averager->getGeneration();
+    }
+
+    // Reduce the visible X range to the plot width:
+    ImPlotRect limits = ImPlot::GetPlotLimits();
+    double first = plan->frequencyToBucket(limits.X.Min * 1'000'000.0);
+    double last = plan->frequencyToBucket(limits.X.Max * 1'000'000.0);
+    unsigned columns = static_cast<unsigned>(std::max(ImPlot::GetPlotSize().x, 1.0f));
+    unsigned count = reducer.reduce(first, last, columns);
+
+    // Column centers from bins to MHz (in place, reduce() overwrites them):
+    double* x = reducer.getBins();
+    for(unsigned i = 0; i < count; i++) {
+        x[i] = plan->bucketToFrequency(x[i]) / 1'000'000.0;
+    }
+    // The min/max fill takes the line's color, only the line is in the legend:
+    ImPlot::PlotLine("Spectrum", x, reducer.getMax(), static_cast<int>(count));
+    ImPlot::SetNextFillStyle(ImPlot::GetLastItemColor());
+    ImPlot::PlotShaded("##SpectrumFill", x, reducer.getMin(), reducer.getMax(), static_cast<int>(count));
+
+    if(showSignals) {
+        plotSignals();
+    }
+
+    // Markers for the VFOs of the channelizer:
+    if(channelized && !vfos.empty()) {
+        std::vector<double> markers;
+        for(auto &v : vfos) {
+            markers.push_back((plan->getCenterFrequency() + v.frequency) / 1'000'000.0);
+        }
+        ImPlot::PlotInfLines("VFOs", markers.data(), static_cast<int>(markers.size()));
+    }
+}
+
+// Markers for the confirmed signals of the detector
+void gui::plotSignals()
+{
+    signalX.clear();
+    signalY.clear();
+    for(const auto& signal : detector->getSignals()) {
+        if(signal.active && signal.confirmed) {
+            signalX.push_back(signal.frequency / 1'000'000.0);
+            signalY.push_back(signal.level);
+        }
+    }
+    ImPlot::PlotScatter("Signals", signalX.data(), signalY.data(), static_cast<int>(signalX.size()));
+}
+
+// The full band is shown initially and after FFT size changes, otherwise
+// the user's zoom and pan are kept
+ImPlotCond gui::xLimitsCondition()
+{
+    return resetXLimits ? ImPlotCond_Always : ImPlotCond_Once;
+}
+
 void gui::renderTX(float width, float height, float xoffset) {
     ImGui::SetNextWindowPos(ImVec2(xoffset, 0), ImGuiCond_Always);
     ImGui::SetNextWindowSize(ImVec2(width,height), ImGuiCond_Always);
     ImGui::Begin("TX", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse);
-    ImGui::Text("This is some useful text.");
+    if (ImGui::CollapsingHeader("Transmitter", ImGuiTreeNodeFlags_DefaultOpen)) {
+        renderTransmitter();
+    }
+
+    if (ImGui::CollapsingHeader("Latency")) {
+        renderLatency();
+    }
+
+    if (ImGui::CollapsingHeader("Statistics")) {
+        renderMetrics();
+    }
     ImGui::End();
 }
 
@@ -302,58 +854,268 @@ void gui::initWaterfall() {
 
     glGenTextures(1, &waterfallTexture);
 
-    // Shader source code
+    // The shader replaces the ImGui backend program while the waterfall
+    // image is drawn, so it uses the same attributes and projection:
+#ifdef __APPLE__
+    const char* glslVersion = "#version 150\n";
+#else
+    const char* glslVersion = "#version 130\n";
+#endif
+
     const char* vertexShaderSource = R"(
-    #version 330 core
-    layout(location = 0) in vec2 aPos;
-    layout(location = 1) in vec2 aTexCoord;
-    out vec2 TexCoord;
+    uniform mat4 ProjMtx;
+    in vec2 Position;
+    in vec2 UV;
+    in vec4 Color;
+    out vec2 Frag_UV;
     void main() {
-        gl_Position = vec4(aPos, 0.0, 1.0);
-        TexCoord = aTexCoord;
+        Frag_UV = UV;
+        gl_Position = ProjMtx * vec4(Position.xy, 0.0, 1.0);
     }
     )";
 
+    // Maps the 8 bit dB values onto the gradient described in prepareGradient():
     const char* fragmentShaderSource = R"(
-    #version 330 core
-    out vec4 FragColor;
-    in vec2 TexCoord;
-    uniform sampler2D texture1;
+    uniform sampler2D Texture;
+    uniform float range;
+    uniform float levelMax;
+    uniform float levelA;
+    uniform float levelB;
+    uniform float levelMin;
+    in vec2 Frag_UV;
+    out vec4 Out_Color;
     void main() {
-        FragColor = texture(texture1, TexCoord);
+        float db = texture(Texture, Frag_UV).r * range - range;
+        vec3 color = vec3(0.0, 0.0, 0.0);
+        if (db > levelMax) {
+            color = vec3(1.0, 1.0, 0.0);
+        } else if (db > levelA) {
+            float j = (levelMax - db) / max(levelMax - levelA, 1.0);
+            color = vec3(1.0, 1.0, j);
+        } else if (db > levelB) {
+            float j = (levelA - db) / max(levelA - levelB, 1.0);
+            color = vec3(1.0 - j, 1.0 - j, 1.0);
+        } else if (db > levelMin) {
+            float j = (levelB - db) / max(levelB - levelMin, 1.0);
+            color = vec3(0.0, 0.0, 1.0 - j);
+        }
+        Out_Color = vec4(color, 1.0);
     }
     )";
 
-    // Compile and link shaders
+    // Compile shaders (linked on first use, see waterfallCallback())
+    const char* vertexSources[] = {glslVersion, vertexShaderSource};
     GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glShaderSource(vertexShader, 2, vertexSources, NULL);
     glCompileShader(vertexShader);
 
+    const char* fragmentSources[] = {glslVersion, fragmentShaderSource};
     GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glShaderSource(fragmentShader, 2, fragmentSources, NULL);
     glCompileShader(fragmentShader);
 
     waterfallShaderProgram = glCreateProgram();
     glAttachShader(waterfallShaderProgram, vertexShader);
     glAttachShader(waterfallShaderProgram, fragmentShader);
-    glLinkProgram(waterfallShaderProgram);
+    waterfallShaderLinked = false;
 
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
-    // Generate texture
+    // Generate texture: one byte per bin, rows wrap around (ring)
     glBindTexture(GL_TEXTURE_2D, waterfallTexture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, N, waterfallBuffer.getRows(), 0, GL_RED, GL_UNSIGNED_BYTE, waterfallBuffer.getData());
+
+    // Same for the zoom waterfall:
+    glGenTextures(1, &zoomTexture);
+    glBindTexture(GL_TEXTURE_2D, zoomTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    resizeZoom(zoom->getN());
 
-    waterfallIndex = 0;
     zoomOffset = N/2-64;
-    qrg = static_cast<float>(fft::bucketToFrequency(zoomOffset, N))/1'000'000.0;
+    qrg = static_cast<float>(plan->bucketToFrequency(zoomOffset))/1'000'000.0;
     renderVFOtrigger = false;
 }
 
+void gui::updateWaterfall()
+{
+    static histogram &uploadTime = metrics::instance().getHistogram("waterfall_upload", "Waterfall row quantization and texture upload");
+    scopedTimer timer(uploadTime);
+
+    // Quantize the newest spectrum and upload only that row:
+    const uint8_t* row = waterfallBuffer.addRow(fourier->getSpectrum());
+    glBindTexture(GL_TEXTURE_2D, waterfallTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, waterfallBuffer.getIndex(), N, 1, GL_RED, GL_UNSIGNED_BYTE, row);
+}
+
+// Reallocates everything that depends on the FFT size
+void gui::resize()
+{
+    N = plan->getN();
+    dynamicRange = static_cast<int>((14.0f+log2f(N))*6);
+    min = std::max(min, -dynamicRange);
+    max = std::max(max, -dynamicRange);
+    prepareGradient();
+
+    reducedGeneration = UINT64_MAX;
+    resetXLimits = true;
+
+    // Start with an empty waterfall of the new width:
+    waterfallBuffer = waterfall(N, 256, static_cast<float>(dynamicRange));
+    glBindTexture(GL_TEXTURE_2D, waterfallTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, N, waterfallBuffer.getRows(), 0, GL_RED, GL_UNSIGNED_BYTE, waterfallBuffer.getData());
+
+    // The zoom waterfall shares the quantization range:
+    resizeZoom(zoomWaterfall.getN());
+
+    // Keep the VFO on the same frequency:
+    renderVFOtrigger = true;
+}
+
+// Zoom FFT of the VFO region, its own spectrum and waterfall
+void gui::renderZoom()
+{
+    // Factor and size change live, the center follows the VFO:
+    const char* factors[] = {"x8", "x16", "x32", "x64", "x128", "x256", "x512"};
+    if(ImGui::Combo("Zoom Factor", &zoomFactorIndex, factors, IM_ARRAYSIZE(factors))) {
+        zoom->setFactor(zoomSpectrum::minFactor << zoomFactorIndex);
+    }
+    const char* sizes[] = {"256", "512", "1024", "2048", "4096", "8192"};
+    if(ImGui::Combo("Zoom FFT Size", &zoomSizeIndex, sizes, IM_ARRAYSIZE(sizes))) {
+        zoom->setN(zoomSpectrum::minN << zoomSizeIndex);
+    }
+    ImGui::Text("Span: %.2f kHz, Resolution: %.2f Hz", zoom->getSpan() / 1'000.0, zoom->getBinWidth());
+
+    updateZoom();
+    if(zoomX.empty()) {
+        return;
+    }
+    double left = zoomX.front() - zoomBinWidth / 2.0 / 1'000'000.0;
+    double right = zoomX.back() + zoomBinWidth / 2.0 / 1'000'000.0;
+    double x1 = filterStart;
+    double x2 = filterEnd;
+
+    ImPlot::SetNextAxesLimits(left, right, min, max, ImPlotCond_Always);
+    if(ImPlot::BeginPlot("##ZoomSpectrum", ImVec2(-1, 100))) {
+        ImPlot::SetupAxis(ImAxis_X1, "", ImPlotAxisFlags_NoTickMarks | ImPlotAxisFlags_NoTickLabels);
+        ImPlot::SetupAxis(ImAxis_Y1, "", ImPlotAxisFlags_NoTickMarks | ImPlotAxisFlags_NoTickLabels);
+        ImPlot::PlotLine("Zoom", zoomX.data(), zoomY.data(), static_cast<int>(zoomY.size()));
+        double y1 = min;
+        double y2 = max;
+        ImPlot::DragRect(0, &x1, &y1, &x2, &y2, ImVec4(0.0, 0.78, 0.0, 0.75), ImPlotDragToolFlags_NoInputs);
+        ImPlot::EndPlot();
+    }
+
+    ImPlot::SetNextAxesLimits(left, right, 0, 127, ImPlotCond_Always);
+    if(ImPlot::BeginPlot("##ZoomWaterfall", ImVec2(-1, 128))) {
+        ImPlot::SetupAxis(ImAxis_X1, "", ImPlotAxisFlags_NoTickMarks | ImPlotAxisFlags_NoTickLabels);
+        ImPlot::SetupAxis(ImAxis_Y1, "", ImPlotAxisFlags_NoTickMarks | ImPlotAxisFlags_NoTickLabels);
+        plotWaterfall(zoomTexture, zoomWaterfall, ImPlotPoint(left, 128), ImPlotPoint(right, 0));
+        double y1 = 0;
+        double y2 = 128;
+        ImPlot::DragRect(0, &x1, &y1, &x2, &y2, ImVec4(0.0, 0.78, 0.0, 0.75), ImPlotDragToolFlags_NoInputs);
+        ImPlot::EndPlot();
+    }
+}
+
+// Takes the newest zoom spectrum (if any) into the plot and the waterfall
+void gui::updateZoom()
+{
+    uint64_t generation = zoom->getSpectrum(zoomGeneration, zoomData, zoomCenter, zoomBinWidth);
+    if(generation == zoomGeneration) {
+        return;
+    }
+    zoomGeneration = generation;
+    uint64_t zoomN = zoomData.size();
+    if(zoomN != zoomWaterfall.getN()) {
+        resizeZoom(zoomN);
+    }
+
+    // The noise per bin scales with the bin width, referenced to the main
+    // bins both views share the level settings:
+    float level = static_cast<float>(10.0 * log10(plan->getBinWidth() / zoomBinWidth));
+    double centerHz = plan->getCenterFrequency() + zoomCenter;
+    zoomX.resize(zoomN);
+    zoomY.resize(zoomN);
+    for(uint64_t k = 0; k < zoomN; k++) {
+        zoomData[k] += level;
+        zoomY[k] = zoomData[k];
+        zoomX[k] = (centerHz + (static_cast<double>(k) - static_cast<double>(zoomN / 2)) * zoomBinWidth) / 1'000'000.0;
+    }
+
+    const uint8_t* row = zoomWaterfall.addRow(zoomData.data());
+    glBindTexture(GL_TEXTURE_2D, zoomTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, zoomWaterfall.getIndex(), zoomN, 1, GL_RED, GL_UNSIGNED_BYTE, row);
+}
+
+// Starts an empty zoom waterfall of the given width
+void gui::resizeZoom(uint64_t zoomN)
+{
+    zoomWaterfall = waterfall(zoomN, 256, static_cast<float>(dynamicRange));
+    glBindTexture(GL_TEXTURE_2D, zoomTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, zoomN, zoomWaterfall.getRows(), 0, GL_RED, GL_UNSIGNED_BYTE, zoomWaterfall.getData());
+}
+
+void gui::plotWaterfall(GLuint texture, waterfall &buffer, ImPlotPoint boundsMin, ImPlotPoint boundsMax)
+{
+    // The oldest row is drawn at the top, so scrolling is just an offset of
+    // the texture coordinates (the texture wraps around):
+    float offset = static_cast<float>(buffer.getIndex() + 1) / static_cast<float>(buffer.getRows());
+
+    ImDrawList* drawList = ImPlot::GetPlotDrawList();
+    drawList->AddCallback(waterfallCallback, this);
+    ImPlot::PlotImage(
+        "", // Waterfall
+        static_cast<intptr_t>(texture),
+        boundsMin,
+        boundsMax,
+        ImVec2(0.0f, offset),
+        ImVec2(1.0f, 1.0f + offset)
+    );
+    drawList->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+}
+
+// Called by the ImGui OpenGL backend while rendering the draw list
+void gui::waterfallCallback(const ImDrawList* /*parentList*/, const ImDrawCmd* cmd)
+{
+    gui* self = static_cast<gui*>(cmd->UserCallbackData);
+    GLuint program = self->waterfallShaderProgram;
+
+    // Borrow attribute locations and projection from the backend program:
+    GLint imguiProgram = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &imguiProgram);
+    if(!self->waterfallShaderLinked) {
+        glBindAttribLocation(program, glGetAttribLocation(imguiProgram, "Position"), "Position");
+        glBindAttribLocation(program, glGetAttribLocation(imguiProgram, "UV"), "UV");
+        glBindAttribLocation(program, glGetAttribLocation(imguiProgram, "Color"), "Color");
+        glLinkProgram(program);
+        self->waterfallShaderLinked = true;
+    }
+    GLfloat projection[16];
+    glGetUniformfv(imguiProgram, glGetUniformLocation(imguiProgram, "ProjMtx"), projection);
+
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "ProjMtx"), 1, GL_FALSE, projection);
+    glUniform1i(glGetUniformLocation(program, "Texture"), 0);
+    glUniform1f(glGetUniformLocation(program, "range"), self->waterfallBuffer.getRange());
+    glUniform1f(glGetUniformLocation(program, "levelMax"), static_cast<float>(self->max));
+    glUniform1f(glGetUniformLocation(program, "levelA"), static_cast<float>(self->gradientA));
+    glUniform1f(glGetUniformLocation(program, "levelB"), static_cast<float>(self->gradientB));
+    glUniform1f(glGetUniformLocation(program, "levelMin"), static_cast<float>(self->min));
+}
+
 void gui::prepareGradient()
 {
     //      yellow
@@ -373,31 +1135,13 @@ void gui::prepareGradient()
     dmax = static_cast<double>(max);
     dmin = static_cast<double>(min);
 
+    // Only the thresholds are computed here, the colors are applied by
+    // the waterfall fragment shader:
     int dist = max - min;
     int aSize = dist/10;
     int bSize = dist/10;
-    int cSize = dist-aSize-bSize;
-    int a = max - aSize;
-    int b = min + bSize;
-    
-    gradient.clear();
-
-    for (int i = 0; i >= -dynamicRange; i--) {
-        if(i > max) { // Yellow
-            gradient[i] = ImVec4(1.0f, 1.0f, 0.f, 1.0f); 
-        } else if(i > a) { // Yellow to White
-            float j = (max - static_cast<float>(i))/aSize;
-            gradient[i] = ImVec4(1.0f, 1.0f, 1.0f*j, 1.0f); 
-        } else if(i > b) { // White to Blue
-            float j = (a - static_cast<float>(i))/cSize;
-            gradient[i] = ImVec4(1.0f-1.0f*j, 1.0f-1.0f*j, 1.0f, 1.0f); 
-        } else if(i > min) { // Blue to Black
-            float j = (b - static_cast<float>(i))/bSize;
-            gradient[i] = ImVec4(0.0f, 0.0f, 1.0f-1.0f*j, 1.0f); 
-        } else { // Black
-            gradient[i] = ImVec4(0.0f, 0.0f, 0.0f, 1.0f); 
-        }
-    }
+    gradientA = max - aSize;
+    gradientB = min + bSize;
 }
 
 void gui::renderVFO(float height) {
@@ -421,8 +1165,13 @@ void gui::dragVFO()
 
         filterStart = f - (filterWidth / 1'000'000.0)/2.0;
         filterEnd = f + (filterWidth / 1'000'000.0)/2.0;
-        int newOffset = static_cast<int>(fft::frequencyToBucket(f*1'000'000.0, N)) - 64; 
+
+        // The single receiver counts its carrier from the lower band edge:
+        double carrierHz = plan->toBaseband(f * 1'000'000.0) + plan->getSampleRate() / 2.0;
+        *carrier = static_cast<uint64_t>(std::clamp(carrierHz, 0.0, plan->getSampleRate()));
+        zoom->setCenter(plan->toBaseband(f * 1'000'000.0));
+        int newOffset = static_cast<int>(plan->frequencyToBucket(f*1'000'000.0)) - 64; 
         zoomOffset = std::max(0, std::min(newOffset, static_cast<int>(N) - 128)); 
-        qrg = static_cast<float>(fft::bucketToFrequency(zoomOffset, N))/1'000'000.0;
+        qrg = static_cast<float>(plan->bucketToFrequency(zoomOffset))/1'000'000.0;
     }
 }
@@ -6,8 +6,25 @@
 #include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <fftw3.h>
 #include "dsp.h"
+#include "averager.h"
+#include "detector.h"
+#include "audio.h"
+#include "channelizer.h"
+#include "wavrecorder.h"
+#include "recorder.h"
+#include "playback.h"
+#include "gapdetector.h"
+#include "transmitter.h"
+#include "tracker.h"
+#include "zoom.h"
+#include "devicecontrol.h"
+#include "metrics.h"
+#include "waterfall.h"
+#include "frequencyplan.h"
+#include "reducer.h"
 
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
@@ -18,20 +35,57 @@ class gui {
 public: 
     gui(
         std::function<bool()> connectCallback,
-        std::function<bool()> fakeConnectCallback,
+        std::function<bool(const std::string&)> fakeConnectCallback,
         std::function<bool()> isConnectedCallback,
-        fftw_complex* fftBuffer,
+        std::function<uint64_t()> overrunCallback,
+        std::function<bool(const std::string&)> playbackCallback,
+        std::function<uint64_t()> publishedCallback,
+        spectrumFft* fourier,
+        spectrumAverager* averager,
+        signalDetector* detector,
+        audio* sound,
+        channelizer* channels,
+        recorder* iqRecorder,
+        playback* player,
+        gapDetector* gaps,
+        transmitter* uplink,
+        beaconTracker* tracker,
+        zoomSpectrum* zoom,
+        deviceControl* control,
+        std::function<void(bool)> channelizedCallback,
+        std::function<void(unsigned)> kernelBuffersCallback,
+        std::function<void(double)> tuneCallback,
         uint64_t *carrier,
-        uint64_t N=4096
+        frequencyPlan* plan
     );
+    ~gui();
     void render();
 private:
 
     // Callbacks:
     std::function<bool()> connectCallback;
-    std::function<bool()> fakeConnectCallback;
+    std::function<bool(const std::string&)> fakeConnectCallback;
     std::function<bool()> isConnectedCallback;
-    fftw_complex* fftBuffer;
+    std::function<uint64_t()> overrunCallback;
+    std::function<bool(const std::string&)> playbackCallback;
+    std::function<uint64_t()> publishedCallback;
+    spectrumFft* fourier;
+    spectrumAverager* averager;
+    signalDetector* detector;
+    audio* sound;
+    channelizer* channels;
+    recorder* iqRecorder;
+    playback* player;
+    std::function<void(bool)> channelizedCallback;
+    std::function<void(unsigned)> kernelBuffersCallback;
+    gapDetector* gaps;
+    int kernelBuffers;
+    transmitter* uplink;
+    beaconTracker* tracker;
+    zoomSpectrum* zoom;
+    deviceControl* control;
+    std::function<void(double)> tuneCallback;
+    frequencyPlan* plan;
 
     // State:
     bool connected;
@@ -41,14 +95,58 @@ private:
     double dmin;
     double dmax;
     int dynamicRange;
-    int historyIndex;
     uint64_t *carrier;
-    std::vector<std::vector<float>> spectrumHistory;
     double filterWidth;
     double filterStart;
     double filterEnd;
     int zoomOffset;
     float qrg;
+    int windowType;
+    float kaiserBeta;
+    int averagingMode;
+    int averagingDepth;
+    float holdDecay;
+    float audioLatency; // ms
+    bool channelized;
+    bool showSignals;
+    float detectorThreshold;
+    void plotSignals();
+    std::vector<double> signalX;
+    std::vector<double> signalY;
+    std::vector<channelizer::vfoInfo> vfos;
+    // Per VFO audio recordings, fed by the VFO's channelizer sink:
+    std::map<int, std::unique_ptr<wavRecorder>> vfoRecorders;
+    void renderVfos();
+    void recordVfo(const channelizer::vfoInfo &v, bool on);
+    void renderRecorder();
+    void renderPlayback();
+    void renderGaps();
+    void renderMetrics();
+    void renderTransmitter();
+    void renderLatency();
+    void renderTracker();
+    void renderTuning();
+    double bandCenter; // MHz
+    char playbackPath[512];
+    char scenarioPath[512];
+
+    // Transmitter:
+    float txOffset;
+    float txPower;
+    float micGain;
+    int txSideband;
+    float micLevel;
+
+    // Metrics panel:
+    bool metricsEnabled;
+    char metricsPath[512];
+    int metricsFormat;
+    float metricsInterval;
+    double throughputTime;
+    uint64_t throughputSamples;
+    double throughput;
+    int fftSizeIndex;
+    void resize();
 
     // Draw Subwindows:
     void renderRX(float width, float height, float xoffset);
@@ -78,16 +176,39 @@ private:
     };
 
     // Waterfall:
-    std::array<float, 4096> frequencyBins;
+    spectrumReducer reducer;
+    uint64_t reducedGeneration;
+    bool resetXLimits;
+    void plotSpectrum();
+    ImPlotCond xLimitsCondition();
     GLuint waterfallTexture;
     GLuint waterfallShaderProgram;
-    int waterfallIndex;
-    std::vector<std::array<int, 4096>> waterfallRingBuffer;
+    bool waterfallShaderLinked;
+    waterfall waterfallBuffer;
     void initWaterfall();
-    std::map<int, ImVec4> gradient;
+    void updateWaterfall();
+    void plotWaterfall(GLuint texture, waterfall &buffer, ImPlotPoint boundsMin, ImPlotPoint boundsMax);
+    static void waterfallCallback(const ImDrawList* parentList, const ImDrawCmd* cmd);
+    int gradientA;
+    int gradientB;
     ImGuiWindow* window;
     void prepareGradient();
     void renderVFO(float height);
     void dragVFO();
     bool renderVFOtrigger;
+
+    // Zoom FFT around the VFO:
+    void renderZoom();
+    void updateZoom();
+    void resizeZoom(uint64_t zoomN);
+    int zoomFactorIndex;
+    int zoomSizeIndex;
+    uint64_t zoomGeneration;
+    std::vector<float> zoomData;
+    std::vector<double> zoomX;
+    std::vector<double> zoomY;
+    double zoomCenter;
+    double zoomBinWidth;
+    waterfall zoomWaterfall;
+    GLuint zoomTexture;
 };
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "iiosource.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+iioSource::iioSource(iio_buffer *buffer, iio_channel *i, double sampleRate) :
+    buffer(buffer),
+    i(i),
+    sampleRate(sampleRate)
+{
+}
+
+size_t iioSource::read(int16_t *out, size_t count)
+{
+    static histogram &refillTime = metrics::instance().getHistogram("iio_refill", "iio_buffer_refill, mostly waiting for the hardware");
+    ssize_t numberOfRxBytes;
+    {
+        scopedTimer timer(refillTime);
+        numberOfRxBytes = iio_buffer_refill(buffer);
+    }
+
+    if(numberOfRxBytes < 0) {
+        std::cout << "ERROR: Error in Refilling rxBuffer" << std::endl;
+        return 0;
+    }
+
+    // READ: Get pointers to RX buf and read IQ from RX buf port 0
+    char *p_dat = (char *)iio_buffer_first(buffer, i);
+    char *p_end = (char *)iio_buffer_end(buffer);
+    ptrdiff_t p_inc = iio_buffer_step(buffer);
+    count = std::min<size_t>(count, (p_end - p_dat) / p_inc);
+
+    // With only rx0i/rx0q enabled the buffer is plain interleaved IQ:
+    if(p_inc == 2 * sizeof(int16_t)) {
+        std::memcpy(out, p_dat, count * p_inc);
+        return count;
+    }
+
+    for(size_t n = 0; n < count; n++, p_dat += p_inc) {
+        out[2 * n + 0] = ((int16_t*)p_dat)[0]; // Real (I)
+        out[2 * n + 1] = ((int16_t*)p_dat)[1]; // Imag (Q)
+    }
+    return count;
+}
@@ -0,0 +1,25 @@
+#ifndef IIOSOURCE_H
+#define IIOSOURCE_H
+
+#include <iio.h>
+#include "samplesource.h"
+
+// The Pluto's RX stream. libiio refills the same user space buffer on every
+// iio_buffer_refill(), so the samples are copied out once into the pooled
+// block; every consumer then shares that one copy.
+class iioSource : public sampleSource {
+    public:
+    iioSource(iio_buffer *buffer, iio_channel *i, double sampleRate);
+
+    size_t read(int16_t *out, size_t count) override;
+    double getSampleRate() override { return sampleRate; }
+    // iio_buffer_refill() blocks until the hardware delivered the block:
+    bool isPaced() override { return true; }
+
+    private:
+    iio_buffer *buffer;
+    iio_channel *i;
+    double sampleRate;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "iqblock.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+iqBlock::iqBlock(const iqBlock &other) : pool(other.pool), index(other.index)
+{
+    if(pool != nullptr) {
+        pool->slots[index].references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+iqBlock::iqBlock(iqBlock &&other) noexcept : pool(other.pool), index(other.index)
+{
+    other.pool = nullptr;
+}
+
+iqBlock& iqBlock::operator=(const iqBlock &other)
+{
+    if(this != &other) {
+        if(other.pool != nullptr) {
+            other.pool->slots[other.index].references.fetch_add(1, std::memory_order_relaxed);
+        }
+        reset();
+        pool = other.pool;
+        index = other.index;
+    }
+    return *this;
+}
+
+iqBlock& iqBlock::operator=(iqBlock &&other) noexcept
+{
+    if(this != &other) {
+        reset();
+        pool = other.pool;
+        index = other.index;
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+// Release pairs with the acquire in blockPool::acquire(), the producer
+// only reuses the memory after every reader is done with it
+void iqBlock::reset()
+{
+    if(pool != nullptr) {
+        pool->slots[index].references.fetch_sub(1, std::memory_order_release);
+        pool = nullptr;
+    }
+}
+
+const int16_t* iqBlock::samples() const
+{
+    return pool->memory + 2 * pool->blockSize * index;
+}
+
+size_t iqBlock::getCount() const
+{
+    return pool->slots[index].count;
+}
+
+uint64_t iqBlock::getSequence() const
+{
+    return pool->slots[index].sequence;
+}
+
+std::chrono::steady_clock::time_point iqBlock::getTime() const
+{
+    return pool->slots[index].time;
+}
+
+blockPool::blockPool(size_t blockSize, size_t count) :
+    blockSize(blockSize),
+    slots(count),
+    next(0),
+    exhausted(0)
+{
+    // aligned_alloc wants a multiple of the alignment:
+    size_t bytes = (2 * blockSize * count * sizeof(int16_t) + 63) & ~size_t(63);
+    memory = static_cast<int16_t*>(std::aligned_alloc(64, bytes));
+    if(memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    std::fill(memory, memory + 2 * blockSize * count, 0);
+}
+
+blockPool::~blockPool()
+{
+    std::free(memory);
+}
+
+// Blocks come back roughly in the order they were handed out, so the
+// round robin search usually succeeds at the first slot
+iqBlock blockPool::acquire()
+{
+    for(size_t i = 0; i < slots.size(); i++) {
+        size_t k = (next + i) % slots.size();
+        if(slots[k].references.load(std::memory_order_acquire) == 0) {
+            slots[k].references.store(1, std::memory_order_relaxed);
+            next = (k + 1) % slots.size();
+            return iqBlock(this, static_cast<uint32_t>(k));
+        }
+    }
+    exhausted.fetch_add(1, std::memory_order_relaxed);
+    return iqBlock();
+}
+
+int16_t* blockPool::data(const iqBlock &block)
+{
+    return memory + 2 * blockSize * block.index;
+}
+
+void blockPool::finish(const iqBlock &block, size_t count, uint64_t sequence, std::chrono::steady_clock::time_point time)
+{
+    count = std::min(count, blockSize);
+    int16_t *samples = data(block);
+    std::fill(samples + 2 * count, samples + 2 * blockSize, 0);
+    slots[block.index].count = count;
+    slots[block.index].sequence = sequence;
+    slots[block.index].time = time;
+}
+
+size_t blockPool::getInUse() const
+{
+    size_t used = 0;
+    for(const auto &s : slots) {
+        used += s.references.load(std::memory_order_relaxed) != 0;
+    }
+    return used;
+}
@@ -0,0 +1,84 @@
+#ifndef IQBLOCK_H
+#define IQBLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "ringbuffer.h"
+
+class blockPool;
+
+// Read-only, reference counted view of one pooled block of raw interleaved
+// int16 IQ samples as delivered by the Pluto. Copying the view shares the
+// block, the block goes back to the pool when the last view is dropped, so
+// any number of consumers read the same samples without copies. Consumers
+// move the view out of their ring slot, so the slot does not keep the
+// block alive.
+class iqBlock {
+    public:
+    iqBlock() : pool(nullptr), index(0) {}
+    iqBlock(const iqBlock &other);
+    iqBlock(iqBlock &&other) noexcept;
+    iqBlock& operator=(const iqBlock &other);
+    iqBlock& operator=(iqBlock &&other) noexcept;
+    ~iqBlock() { reset(); }
+
+    void reset();
+    bool empty() const { return pool == nullptr; }
+
+    // Always blockSize samples, a short block is zero padded:
+    const int16_t* samples() const;
+    // Samples the source actually delivered:
+    size_t getCount() const;
+    uint64_t getSequence() const;
+    // When the source delivered the last sample of the block:
+    std::chrono::steady_clock::time_point getTime() const;
+
+    private:
+    friend class blockPool;
+    iqBlock(blockPool *pool, uint32_t index) : pool(pool), index(index) {}
+
+    blockPool *pool;
+    uint32_t index;
+};
+
+// Fixed set of 64 byte aligned blocks, allocated once. Only the producer
+// (acquisition thread) takes blocks, any thread may drop the last view.
+class blockPool {
+    public:
+    blockPool(size_t blockSize, size_t count);
+    ~blockPool();
+
+    // Producer: a free block, empty if every block is still lent out
+    iqBlock acquire();
+    // Producer: the block to fill, only valid until it is published
+    int16_t* data(const iqBlock &block);
+    // Producer: zero pads and stamps the block before it is handed out
+    void finish(const iqBlock &block, size_t count, uint64_t sequence, std::chrono::steady_clock::time_point time);
+
+    size_t getBlockSize() const { return blockSize; }
+    size_t getCapacity() const { return slots.size(); }
+    size_t getInUse() const;
+    uint64_t getExhausted() const { return exhausted.load(std::memory_order_relaxed); }
+
+    private:
+    friend class iqBlock;
+
+    struct slot {
+        std::atomic<uint32_t> references{0};
+        size_t count = 0;
+        uint64_t sequence = 0;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    size_t blockSize;
+    int16_t *memory;
+    std::vector<slot> slots;
+    size_t next;
+    std::atomic<uint64_t> exhausted;
+};
+
+typedef ringBuffer<iqBlock> iqRing;
+
+#endif
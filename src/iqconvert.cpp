@@ -0,0 +1,179 @@
+#include "iqconvert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IQCONVERT_X86
+#endif
+
+static constexpr float scaleFloat = 1.0f / 32768.0f;
+static constexpr double scaleDouble = 1.0 / 32768.0;
+
+// Scalar kernels (also the tail handling of the SIMD kernels):
+static void convertScalar(const int16_t *in, size_t n, double *out)
+{
+    for(size_t k = 0; k < n; k++) {
+        out[k] = static_cast<double>(in[k]) * scaleDouble;
+    }
+}
+
+static void convertScalar(const int16_t *in, size_t n, float *out)
+{
+    for(size_t k = 0; k < n; k++) {
+        out[k] = static_cast<float>(in[k]) * scaleFloat;
+    }
+}
+
+static void deinterleaveScalar(const int16_t *in, size_t count, float *i, float *q)
+{
+    for(size_t k = 0; k < count; k++) {
+        i[k] = static_cast<float>(in[2 * k + 0]) * scaleFloat;
+        q[k] = static_cast<float>(in[2 * k + 1]) * scaleFloat;
+    }
+}
+
+#ifdef IQCONVERT_X86
+
+// SSE2 kernels:
+__attribute__((target("sse2")))
+static void convertSse2(const int16_t *in, size_t n, double *out)
+{
+    const __m128d scale = _mm_set1_pd(scaleDouble);
+    size_t k = 0;
+    for(; k + 8 <= n; k += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_pd(out + k + 0, _mm_mul_pd(_mm_cvtepi32_pd(lo), scale));
+        _mm_storeu_pd(out + k + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(lo, lo)), scale));
+        _mm_storeu_pd(out + k + 4, _mm_mul_pd(_mm_cvtepi32_pd(hi), scale));
+        _mm_storeu_pd(out + k + 6, _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(hi, hi)), scale));
+    }
+    convertScalar(in + k, n - k, out + k);
+}
+
+__attribute__((target("sse2")))
+static void convertSse2(const int16_t *in, size_t n, float *out)
+{
+    const __m128 scale = _mm_set1_ps(scaleFloat);
+    size_t k = 0;
+    for(; k + 8 <= n; k += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + k + 0, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + k + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    convertScalar(in + k, n - k, out + k);
+}
+
+__attribute__((target("sse2")))
+static void deinterleaveSse2(const int16_t *in, size_t count, float *i, float *q)
+{
+    const __m128 scale = _mm_set1_ps(scaleFloat);
+    size_t k = 0;
+    for(; k + 4 <= count; k += 4) {
+        // Each 32 bit lane holds one IQ pair, I in the low half:
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * k));
+        __m128i re = _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+        __m128i im = _mm_srai_epi32(x, 16);
+        _mm_storeu_ps(i + k, _mm_mul_ps(_mm_cvtepi32_ps(re), scale));
+        _mm_storeu_ps(q + k, _mm_mul_ps(_mm_cvtepi32_ps(im), scale));
+    }
+    deinterleaveScalar(in + 2 * k, count - k, i + k, q + k);
+}
+
+// AVX2 kernels:
+__attribute__((target("avx2")))
+static void convertAvx2(const int16_t *in, size_t n, double *out)
+{
+    const __m256d scale = _mm256_set1_pd(scaleDouble);
+    size_t k = 0;
+    for(; k + 8 <= n; k += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k));
+        __m256i w = _mm256_cvtepi16_epi32(x);
+        _mm256_storeu_pd(out + k + 0, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(w)), scale));
+        _mm256_storeu_pd(out + k + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(w, 1)), scale));
+    }
+    convertScalar(in + k, n - k, out + k);
+}
+
+__attribute__((target("avx2")))
+static void convertAvx2(const int16_t *in, size_t n, float *out)
+{
+    const __m256 scale = _mm256_set1_ps(scaleFloat);
+    size_t k = 0;
+    for(; k + 16 <= n; k += 16) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + k));
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1));
+        _mm256_storeu_ps(out + k + 0, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(out + k + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+    convertScalar(in + k, n - k, out + k);
+}
+
+__attribute__((target("avx2")))
+static void deinterleaveAvx2(const int16_t *in, size_t count, float *i, float *q)
+{
+    const __m256 scale = _mm256_set1_ps(scaleFloat);
+    size_t k = 0;
+    for(; k + 8 <= count; k += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * k));
+        __m256i re = _mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16);
+        __m256i im = _mm256_srai_epi32(x, 16);
+        _mm256_storeu_ps(i + k, _mm256_mul_ps(_mm256_cvtepi32_ps(re), scale));
+        _mm256_storeu_ps(q + k, _mm256_mul_ps(_mm256_cvtepi32_ps(im), scale));
+    }
+    deinterleaveScalar(in + 2 * k, count - k, i + k, q + k);
+}
+
+#endif
+
+// Runtime dispatch:
+struct iqKernels {
+    void (*toDouble)(const int16_t*, size_t, double*);
+    void (*toFloat)(const int16_t*, size_t, float*);
+    void (*deinterleave)(const int16_t*, size_t, float*, float*);
+    const char* name;
+};
+
+static iqKernels selectKernels()
+{
+#ifdef IQCONVERT_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return {convertAvx2, convertAvx2, deinterleaveAvx2, "avx2"};
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return {convertSse2, convertSse2, deinterleaveSse2, "sse2"};
+    }
+#endif
+    // Other architectures (e.g. arm64) rely on the compiler vectorizing the scalar loops
+    return {convertScalar, convertScalar, deinterleaveScalar, "scalar"};
+}
+
+static const iqKernels& kernels()
+{
+    static const iqKernels selected = selectKernels();
+    return selected;
+}
+
+void convertIq(const int16_t *in, size_t count, double *out)
+{
+    kernels().toDouble(in, 2 * count, out);
+}
+
+void convertIq(const int16_t *in, size_t count, float *out)
+{
+    kernels().toFloat(in, 2 * count, out);
+}
+
+void deinterleaveIq(const int16_t *in, size_t count, float *i, float *q)
+{
+    kernels().deinterleave(in, count, i, q);
+}
+
+const char* iqConvertKernel()
+{
+    return kernels().name;
+}
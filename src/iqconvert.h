@@ -0,0 +1,21 @@
+#ifndef IQCONVERT_H
+#define IQCONVERT_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Bulk conversion of raw interleaved int16 IQ samples (as delivered by the
+// Pluto) into floating point samples scaled to [-1.0, 1.0).
+// The kernel (AVX2, SSE2 or scalar) is selected once at runtime by CPU features.
+
+// Interleaved in, interleaved out (e.g. fftw_complex or std::complex<float>):
+void convertIq(const int16_t *in, size_t count, double *out);
+void convertIq(const int16_t *in, size_t count, float *out);
+
+// Interleaved in, separate I and Q arrays out:
+void deinterleaveIq(const int16_t *in, size_t count, float *i, float *q);
+
+// Name of the kernel selected for this CPU:
+const char* iqConvertKernel();
+
+#endif
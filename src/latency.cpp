@@ -0,0 +1,375 @@
+#include "latency.h"
+#include "iqconvert.h"
+#include "metrics.h"
+#include <cmath>
+#include <iostream>
+
+void clockFit::reset()
+{
+    count = 0;
+    previous = std::numeric_limits<double>::infinity();
+    current = std::numeric_limits<double>::infinity();
+}
+
+void clockFit::add(double offset)
+{
+    current = std::min(current, offset);
+    if(++count == window) {
+        previous = current;
+        current = std::numeric_limits<double>::infinity();
+        count = 0;
+    }
+}
+
+latencyMeter::latencyMeter(iqRing *ring, double sampleRate, uint64_t blockSize) :
+    sampleRate(sampleRate),
+    blockSize(blockSize),
+    epoch(std::chrono::steady_clock::now()),
+    txChannel(0),
+    txDac(0),
+    transmission(0),
+    txDelay(0.0),
+    ring(ring),
+    running(false),
+    restart(true),
+    rxStarted(false),
+    rxStart(0),
+    expectedSequence(0),
+    stagedCount(0),
+    historyCount(0),
+    forward(nullptr),
+    backward(nullptr),
+    enabled(false),
+    frequency(0.0),
+    searchRange(300.0),
+    delay(0.0),
+    smoothedDelay(0.0),
+    frequencyOffset(0.0),
+    quality(0.0),
+    reference(0.0),
+    measurements(0),
+    misses(0)
+{
+    decimation = static_cast<unsigned int>(std::lround(sampleRate / ssb::channelRate));
+    intervalSamples = static_cast<uint64_t>(interval * ssb::channelRate);
+
+    // BPSK chips of a maximum length sequence (x^9 + x^5 + 1), its
+    // autocorrelation is flat apart from the peak:
+    unsigned int state = 0x1ff;
+    for(unsigned int c = 0; c < chips; c++) {
+        float chip = (state & 1) ? 1.0f : -1.0f;
+        burstSamples.insert(burstSamples.end(), samplesPerChip, std::complex<float>(chip, 0.0f));
+        unsigned int feedback = (state ^ (state >> 4)) & 1;
+        state = (state >> 1) | (feedback << 8);
+    }
+    probe.resize(1024);
+
+    // liquid's Kaiser decimator is 2 * decimatorDelay * decimation + 1
+    // taps long, i.e. delays by decimatorDelay channel samples:
+    decimator = firdecim_crcf_create_kaiser(decimation, decimatorDelay, 60.0f);
+    staged.resize(blockSize + decimation);
+    decimated.resize(staged.size() / decimation + 1);
+    history.resize(historySize);
+
+    window = (complex*) fftwTraits<float>::malloc(sizeof(complex) * correlationSize);
+    spectrum = (complex*) fftwTraits<float>::malloc(sizeof(complex) * correlationSize);
+    product = (complex*) fftwTraits<float>::malloc(sizeof(complex) * correlationSize);
+    correlation = (complex*) fftwTraits<float>::malloc(sizeof(complex) * correlationSize);
+
+    metrics &registry = metrics::instance();
+    registry.addProbe(this, "latency_seconds", "Last measured round trip", [this]() { return delay.load(); });
+    registry.addProbe(this, "latency_frequency_offset_hz", "Frequency offset of the last echo", [this]() { return frequencyOffset.load(); });
+    registry.addProbe(this, "latency_quality", "Correlation peak over mean of the last echo", [this]() { return quality.load(); });
+
+    running = true;
+    meterThread = std::thread(&latencyMeter::run, this);
+}
+
+latencyMeter::~latencyMeter()
+{
+    metrics::instance().removeProbes(this);
+    running = false;
+    if(meterThread.joinable()) {
+        meterThread.join();
+    }
+    firdecim_crcf_destroy(decimator);
+    fftwTraits<float>::free(window);
+    fftwTraits<float>::free(spectrum);
+    fftwTraits<float>::free(product);
+    fftwTraits<float>::free(correlation);
+}
+
+double latencyMeter::now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void latencyMeter::setEnabled(bool on)
+{
+    if(on && !enabled) {
+        std::lock_guard<std::mutex> lock(txMutex);
+        bursts.clear();
+        restart = true;
+        smoothedDelay = 0.0;
+    }
+    enabled = on;
+}
+
+void latencyMeter::txStart()
+{
+    std::lock_guard<std::mutex> lock(txMutex);
+    txFit.reset();
+    txChannel = 0;
+    txDac = 0;
+    transmission++;
+}
+
+const std::complex<float>* latencyMeter::nextProbe(size_t count)
+{
+    // Counted in any case, the meter may be switched on mid transmission:
+    uint64_t first = txChannel;
+    txChannel += count;
+    if(!enabled) {
+        return nullptr;
+    }
+
+    if(count > probe.size()) {
+        probe.resize(count);
+    }
+    for(size_t k = 0; k < count; k++) {
+        uint64_t position = (first + k) % intervalSamples;
+        if(position == 0) {
+            std::lock_guard<std::mutex> lock(txMutex);
+            bursts.push_back({(first + k) * decimation, transmission, std::numeric_limits<double>::quiet_NaN()});
+        }
+        probe[k] = position < burstSamples.size() ? 0.7f * burstSamples[position] : 0.0f;
+    }
+    return probe.data();
+}
+
+// A push returns once a queued block played out, so the block just pushed
+// starts playing after the other kernelBuffers - 1 blocks. Earlier returns
+// (while the queue fills up) only make the estimate later, which the
+// lower envelope ignores.
+void latencyMeter::txPushed(size_t count, unsigned kernelBuffers)
+{
+    std::lock_guard<std::mutex> lock(txMutex);
+    double play = now() + (kernelBuffers - 1) * static_cast<double>(count) / sampleRate;
+    txFit.add(play - static_cast<double>(txDac) / sampleRate);
+    txDac += count;
+
+    double start = txFit.get();
+    double offset = txDelay * decimation;
+    for(auto &b : bursts) {
+        if(b.transmission == transmission) {
+            b.playTime = start + (static_cast<double>(b.dacSample) + offset) / sampleRate;
+        }
+    }
+}
+
+// Runs on the meter thread, always drains the ring so it never counts as
+// an overrun, and only does work while measuring
+void latencyMeter::run()
+{
+    // Planning can take a while, the reference spectrum is needed only once:
+    forward = fftPlanner<float>::instance().getPlan(correlationSize, FFTW_FORWARD);
+    backward = fftPlanner<float>::instance().getPlan(correlationSize, FFTW_BACKWARD);
+    std::fill(reinterpret_cast<float*>(window), reinterpret_cast<float*>(window + correlationSize), 0.0f);
+    std::copy(burstSamples.begin(), burstSamples.end(), reinterpret_cast<std::complex<float>*>(window));
+    fftwTraits<float>::execute(forward, window, spectrum);
+    burstSpectrum.resize(correlationSize);
+    for(uint64_t k = 0; k < correlationSize; k++) {
+        burstSpectrum[k] = std::conj(reinterpret_cast<std::complex<float>*>(spectrum)[k]);
+    }
+
+    while(running) {
+        iqBlock *slot = ring->readSlot();
+        if(slot == nullptr) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        iqBlock block = std::move(*slot);
+        ring->commitRead();
+
+        if(enabled) {
+            process(block);
+            block.reset();
+            checkBursts();
+        }
+    }
+}
+
+void latencyMeter::process(const iqBlock &block)
+{
+    uint64_t sequence = block.getSequence();
+    if(restart || !rxStarted || sequence < expectedSequence
+       || (sequence - expectedSequence) * blockSize > historySize * decimation) {
+        restart = false;
+        rxStarted = true;
+        rxFit.reset();
+        rxStart = sequence * blockSize;
+        expectedSequence = sequence;
+        stagedCount = 0;
+        historyCount = 0;
+        firdecim_crcf_reset(decimator);
+    }
+
+    // Lost blocks are replaced by zeros, so the history stays aligned with
+    // the sample counter:
+    while(expectedSequence < sequence) {
+        feed(nullptr);
+        expectedSequence++;
+    }
+
+    auto time = std::chrono::duration<double>(block.getTime() - epoch).count();
+    rxFit.add(time - static_cast<double>(sequence * blockSize + block.getCount()) / sampleRate);
+    feed(block.samples());
+    expectedSequence++;
+}
+
+void latencyMeter::feed(const int16_t *samples)
+{
+    std::complex<float> *in = staged.data() + stagedCount;
+    if(samples == nullptr) {
+        std::fill(in, in + blockSize, 0.0f);
+    } else {
+        convertIq(samples, blockSize, reinterpret_cast<float*>(in));
+    }
+    mixer.setFrequency(frequency, sampleRate);
+    mixer.mixDown(in, in, blockSize);
+    stagedCount += blockSize;
+
+    size_t count = stagedCount / decimation;
+    firdecim_crcf_execute_block(decimator, staged.data(), static_cast<unsigned int>(count), decimated.data());
+    std::copy(staged.begin() + count * decimation, staged.begin() + stagedCount, staged.begin());
+    stagedCount -= count * decimation;
+
+    for(size_t k = 0; k < count; k++) {
+        history[(historyCount + k) & (historySize - 1)] = decimated[k];
+    }
+    historyCount += count;
+}
+
+// Correlates every burst whose search window has been received
+void latencyMeter::checkBursts()
+{
+    if(!rxFit.isValid()) {
+        return;
+    }
+    while(true) {
+        burst b;
+        {
+            std::lock_guard<std::mutex> lock(txMutex);
+            if(bursts.empty() || std::isnan(bursts.front().playTime)) {
+                return;
+            }
+            b = bursts.front();
+        }
+
+        // Channel sample the burst would arrive at without any delay:
+        double rxSample = (b.playTime - rxFit.get()) * sampleRate;
+        double expected = (rxSample - static_cast<double>(rxStart)) / decimation + decimatorDelay;
+        // Right after the start the history may not reach back as far:
+        int64_t start = std::max<int64_t>(0, static_cast<int64_t>(std::floor(expected - margin * ssb::channelRate)));
+        if(start + static_cast<int64_t>(correlationSize) > static_cast<int64_t>(historyCount)) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(txMutex);
+            bursts.pop_front();
+        }
+        if(static_cast<uint64_t>(start) + historySize < historyCount) {
+            misses++;
+            continue;
+        }
+        correlate(b, start);
+    }
+}
+
+void latencyMeter::correlate(const burst &b, int64_t start)
+{
+    static histogram &correlateTime = metrics::instance().getHistogram("latency_correlate", "Echo search over all frequency offsets");
+    scopedTimer timer(correlateTime);
+
+    std::complex<float> *x = reinterpret_cast<std::complex<float>*>(window);
+    for(uint64_t n = 0; n < correlationSize; n++) {
+        x[n] = history[(start + n) & (historySize - 1)];
+    }
+    fftwTraits<float>::execute(forward, window, spectrum);
+
+    // Frequency hypotheses a bin shift apart, spaced so that the burst
+    // loses at most a few dB between two of them:
+    const std::complex<float> *X = reinterpret_cast<const std::complex<float>*>(spectrum);
+    std::complex<float> *P = reinterpret_cast<std::complex<float>*>(product);
+    const std::complex<float> *c = reinterpret_cast<const std::complex<float>*>(correlation);
+    double binWidth = ssb::channelRate / correlationSize;
+    double burstLength = static_cast<double>(burstSamples.size());
+    int64_t step = std::max<int64_t>(1, static_cast<int64_t>(ssb::channelRate / (2.0 * burstLength) / binWidth));
+    int64_t maxShift = static_cast<int64_t>(searchRange / binWidth) / step * step;
+    int64_t lags = static_cast<int64_t>(correlationSize - burstSamples.size());
+
+    float bestPeak = 0.0f;
+    double bestMean = 1.0;
+    int64_t bestShift = 0;
+    int64_t bestLag = 0;
+    float before = 0.0f;
+    float after = 0.0f;
+    for(int64_t shift = -maxShift; shift <= maxShift; shift += step) {
+        for(int64_t k = 0; k < static_cast<int64_t>(correlationSize); k++) {
+            P[k] = X[(k + shift + correlationSize) % correlationSize] * burstSpectrum[k];
+        }
+        fftwTraits<float>::execute(backward, product, correlation);
+
+        float peak = 0.0f;
+        int64_t lag = 0;
+        double sum = 0.0;
+        for(int64_t t = 0; t <= lags; t++) {
+            float m = std::abs(c[t]);
+            sum += m;
+            if(m > peak) {
+                peak = m;
+                lag = t;
+            }
+        }
+        if(peak > bestPeak) {
+            bestPeak = peak;
+            bestMean = sum / (lags + 1);
+            bestShift = shift;
+            bestLag = lag;
+            before = lag > 0 ? std::abs(c[lag - 1]) : peak;
+            after = lag < lags ? std::abs(c[lag + 1]) : peak;
+        }
+    }
+
+    quality = bestMean > 0.0 ? bestPeak / bestMean : 0.0;
+    if(quality < minQuality) {
+        misses++;
+        return;
+    }
+
+    // Sub-sample lag from a parabola through the peak:
+    double denominator = before - 2.0 * bestPeak + after;
+    double fraction = denominator != 0.0 ? 0.5 * (before - after) / denominator : 0.0;
+
+    // Residual frequency from the phase drift between the two halves of
+    // the despread burst:
+    std::complex<double> first = 0.0;
+    std::complex<double> second = 0.0;
+    size_t half = burstSamples.size() / 2;
+    for(size_t n = 0; n < burstSamples.size(); n++) {
+        double phase = -2.0 * M_PI * bestShift * static_cast<double>(n) / correlationSize;
+        std::complex<double> v = std::complex<double>(x[bestLag + n] * std::conj(burstSamples[n])) * std::polar(1.0, phase);
+        (n < half ? first : second) += v;
+    }
+    double residual = std::arg(second * std::conj(first)) / (2.0 * M_PI * half / ssb::channelRate);
+    frequencyOffset = bestShift * binWidth + residual;
+
+    // The decimator output k stands for input sample (k + 1) * decimation - 1:
+    double echo = static_cast<double>(start) + bestLag + fraction - decimatorDelay;
+    double echoSample = static_cast<double>(rxStart) + (echo + 1.0) * decimation - 1.0;
+    double echoTime = rxFit.get() + echoSample / sampleRate;
+    delay = echoTime - b.playTime;
+    smoothedDelay = measurements == 0 || smoothedDelay == 0.0 ? delay.load() : 0.8 * smoothedDelay + 0.2 * delay;
+    measurements++;
+}
@@ -0,0 +1,166 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <complex>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <liquid.h>
+#include "dsp.h"
+#include "fftplanner.h"
+#include "iqblock.h"
+
+// Lower envelope of (timestamp - sample / rate) over the last two windows.
+// Timestamps are only ever late (scheduling, queueing), so the smallest
+// offset seen is the best estimate of when sample 0 happened. The window
+// lets the estimate follow the drift between the Pluto and the host clock.
+class clockFit {
+    public:
+    clockFit(unsigned window = 64) : window(window) { reset(); }
+    void reset();
+    void add(double offset);
+    double get() const { return std::min(previous, current); }
+    bool isValid() const { return get() != std::numeric_limits<double>::infinity(); }
+
+    private:
+    unsigned window;
+    unsigned count;
+    double previous;
+    double current;
+};
+
+// Round trip measurement through the satellite (or any loopback). While
+// measuring, the transmitter replaces its channel signal by a PN burst
+// every `interval`. The meter consumes its own RX ring on a background
+// thread: the downlink channel is mixed to DC, decimated to the channel
+// rate and searched for the echo by FFT cross-correlation against the
+// burst, over a grid of frequency offsets (LNB drift, Doppler) by shifting
+// the spectrum. TX and RX blocks carry sample counters and timestamps
+// which map both streams onto one clock, so the correlation lag becomes an
+// absolute delay. The delay includes the queues of both directions, a
+// local loopback measurement can be stored as reference and subtracted.
+class latencyMeter {
+    public:
+    latencyMeter(iqRing *ring, double sampleRate = 576'000.0, uint64_t blockSize = 8192);
+    ~latencyMeter();
+
+    void setEnabled(bool on);
+    bool isEnabled() { return enabled; }
+    // Downlink channel offset from the center of the RX baseband in Hz:
+    void setFrequency(double offset) { frequency = offset; }
+    // Frequency offsets of +-range Hz are searched:
+    void setSearchRange(double range) { searchRange = range; }
+    double getSearchRange() { return searchRange; }
+
+    // Transmitter side, called from the TX thread:
+    // A new transmission starts, the DAC clock starts over
+    void txStart();
+    // Burst samples for the next `count` channel samples, nullptr if the
+    // meter is off (the audio is sent as usual then)
+    const std::complex<float>* nextProbe(size_t count);
+    // A TX block of `count` samples was pushed and the push returned
+    void txPushed(size_t count, unsigned kernelBuffers);
+    void setTxDelay(double channelSamples) { txDelay = channelSamples; }
+
+    // Results:
+    double getDelay() { return delay; } // s
+    double getSmoothedDelay() { return smoothedDelay; } // s
+    double getDelaySamples() { return delay * sampleRate; }
+    double getFrequencyOffset() { return frequencyOffset; } // Hz
+    double getQuality() { return quality; } // Correlation peak / mean
+    uint64_t getMeasurements() { return measurements; }
+    uint64_t getMisses() { return misses; }
+    // The current estimate becomes the loopback reference:
+    void setReference() { reference = smoothedDelay.load(); }
+    void clearReference() { reference = 0.0; }
+    double getReference() { return reference; }
+
+    static constexpr unsigned int chips = 511; // 9 bit m-sequence
+    static constexpr unsigned int samplesPerChip = 6; // 2 kchip/s
+    static constexpr double interval = 2.0; // s between bursts
+    static constexpr uint64_t correlationSize = 32'768; // 2.7 s at the channel rate
+    static constexpr uint64_t historySize = 131'072; // Power of two
+    static constexpr double margin = 0.25; // s searched before the expected echo
+    static constexpr double minQuality = 8.0;
+
+    private:
+    struct burst {
+        uint64_t dacSample;
+        uint64_t transmission;
+        double playTime;
+    };
+
+    void run();
+    void process(const iqBlock &block);
+    // One block into the history, nullptr for a lost block (zeros):
+    void feed(const int16_t *samples);
+    void checkBursts();
+    void correlate(const burst &b, int64_t start);
+    double now();
+
+    double sampleRate;
+    uint64_t blockSize;
+    unsigned int decimation; // sampleRate / channelRate
+    std::chrono::steady_clock::time_point epoch;
+
+    // Reference burst at the channel rate and its conjugate spectrum:
+    std::vector<std::complex<float>> burstSamples;
+    std::vector<std::complex<float>> burstSpectrum;
+    std::vector<std::complex<float>> probe;
+    uint64_t intervalSamples;
+
+    // TX side, guarded by txMutex:
+    std::mutex txMutex;
+    clockFit txFit;
+    uint64_t txChannel;
+    uint64_t txDac;
+    uint64_t transmission;
+    std::deque<burst> bursts;
+    std::atomic<double> txDelay;
+
+    // RX side, only touched by the meter thread:
+    iqRing *ring;
+    std::thread meterThread;
+    std::atomic<bool> running;
+    clockFit rxFit;
+    std::atomic<bool> restart;
+    bool rxStarted;
+    uint64_t rxStart; // RX sample at decimated sample 0
+    uint64_t expectedSequence;
+    oscillator mixer;
+    firdecim_crcf decimator;
+    static constexpr unsigned int decimatorDelay = 4; // Channel rate samples
+    std::vector<std::complex<float>> staged;
+    size_t stagedCount;
+    std::vector<std::complex<float>> decimated;
+    std::vector<std::complex<float>> history;
+    uint64_t historyCount;
+
+    // Correlation buffers (fftwf_malloc aligned):
+    typedef fftwTraits<float>::complex complex;
+    complex *window;
+    complex *spectrum;
+    complex *product;
+    complex *correlation;
+    fftPlanner<float>::plan forward;
+    fftPlanner<float>::plan backward;
+
+    std::atomic<bool> enabled;
+    std::atomic<double> frequency;
+    std::atomic<double> searchRange;
+    std::atomic<double> delay;
+    std::atomic<double> smoothedDelay;
+    std::atomic<double> frequencyOffset;
+    std::atomic<double> quality;
+    std::atomic<double> reference;
+    std::atomic<uint64_t> measurements;
+    std::atomic<uint64_t> misses;
+};
+
+#endif
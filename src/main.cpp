@@ -87,16 +87,34 @@ int main(int, char**)
 
     // Main loop
     bool done = false;
-    uint64_t N = 4096;
-    uint64_t carrier = 576'000/2;
-    pluto pluto(N);
+    frequencyPlan plan;
+    uint64_t carrier = static_cast<uint64_t>(plan.getSampleRate())/2;
+
+    pluto pluto(&plan);
     gui gui(
         std::bind(&pluto::connect, &pluto),
-        std::bind(&pluto::fakeConnect, &pluto),
+        [&pluto](const std::string &scenario) { return pluto.fakeConnect(scenario); },
         std::bind(&pluto::isConnected, &pluto),
-        pluto.getFftBuffer(),
+        std::bind(&pluto::getOverruns, &pluto),
+        [&pluto](const std::string &path) { return pluto.playbackConnect(path); },
+        std::bind(&pluto::getPublishedSamples, &pluto),
+        pluto.getFourier(),
+        pluto.getAverager(),
+        pluto.getDetector(),
+        pluto.getAudio(),
+        pluto.getChannelizer(),
+        pluto.getRecorder(),
+        pluto.getPlayback(),
+        pluto.getGapDetector(),
+        pluto.getTransmitter(),
+        pluto.getTracker(),
+        pluto.getZoom(),
+        pluto.getControl(),
+        [&pluto](bool channelized) { pluto.setReceiverMode(channelized ? pluto::CHANNELIZED : pluto::SINGLE); },
+        [&pluto](unsigned count) { pluto.setKernelBuffers(count); },
+        [&pluto](double center) { pluto.tune(center); },
         &carrier,
-        N
+        &plan
     );
 
     while (!done)
@@ -116,6 +134,10 @@ int main(int, char**)
                 done = true;
         }
 
+        // Consume acquired samples even while minimized, the acquisition
+        // thread keeps running regardless of the GUI:
+        pluto.processSamples(carrier);
+
         if (SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED)
         {
             SDL_Delay(10);
@@ -127,14 +149,6 @@ int main(int, char**)
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
 
-        if(pluto.isConnected()) {
-            pluto.getSamples(carrier);
-        }
-
-        if(pluto.isFakeConnected()) {
-            pluto.getFakeSamples(carrier);
-        }
-
         gui.render();
 
         // Rendering
@@ -0,0 +1,251 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+std::atomic<bool> metrics::enabled(false);
+
+histogram::histogram(const std::string &name, const std::string &help) :
+    name(name),
+    help(help),
+    count(0),
+    sum(0),
+    max(0)
+{
+    for(auto &c : counts) {
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Values below 16 get a bucket each, above that the top 5 bits (leading
+// one plus 4 sub-bucket bits) select the bucket
+int histogram::index(uint64_t v)
+{
+    if(v < subBuckets) {
+        return static_cast<int>(v);
+    }
+    int exponent = 63 - __builtin_clzll(v);
+    return (exponent - subBits + 1) * subBuckets + static_cast<int>((v >> (exponent - subBits)) & (subBuckets - 1));
+}
+
+double histogram::midpoint(int index)
+{
+    if(index < subBuckets) {
+        return index;
+    }
+    int exponent = index / subBuckets + subBits - 1;
+    int sub = index % subBuckets;
+    double width = static_cast<double>(uint64_t(1) << (exponent - subBits));
+    return (subBuckets + sub) * width + width / 2.0;
+}
+
+double histogram::getMean() const
+{
+    uint64_t n = getCount();
+    return n == 0 ? 0.0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / n;
+}
+
+double histogram::getPercentile(double p) const
+{
+    uint64_t n = getCount();
+    if(n == 0) {
+        return 0.0;
+    }
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(p * n + 0.5));
+    uint64_t seen = 0;
+    for(int i = 0; i < bucketCount; i++) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if(seen >= target) {
+            return std::min(midpoint(i), static_cast<double>(getMax()));
+        }
+    }
+    return static_cast<double>(getMax());
+}
+
+metrics::metrics() : dumping(false), dumpInterval(10.0), dumpFormat(JSON)
+{
+}
+
+metrics::~metrics()
+{
+    stopDump();
+}
+
+metrics& metrics::instance()
+{
+    static metrics registry;
+    return registry;
+}
+
+histogram& metrics::getHistogram(const std::string &name, const std::string &help)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for(auto &h : histograms) {
+        if(h.name == name) {
+            return h;
+        }
+    }
+    return histograms.emplace_back(name, help);
+}
+
+counter& metrics::getCounter(const std::string &name, const std::string &help)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for(auto &c : counters) {
+        if(c.name == name) {
+            return c;
+        }
+    }
+    return counters.emplace_back(name, help);
+}
+
+void metrics::addProbe(const void *owner, const std::string &name, const std::string &help, std::function<double()> probe)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    probes.push_back({owner, name, help, probe});
+}
+
+void metrics::removeProbes(const void *owner)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    probes.erase(std::remove_if(probes.begin(), probes.end(), [owner](const probe &p) { return p.owner == owner; }), probes.end());
+}
+
+std::vector<const histogram*> metrics::getHistograms()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::vector<const histogram*> result;
+    for(auto &h : histograms) {
+        result.push_back(&h);
+    }
+    return result;
+}
+
+std::vector<const counter*> metrics::getCounters()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::vector<const counter*> result;
+    for(auto &c : counters) {
+        result.push_back(&c);
+    }
+    return result;
+}
+
+std::vector<metrics::probeValue> metrics::getProbes()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::vector<probeValue> result;
+    for(auto &p : probes) {
+        result.push_back({p.name, p.read()});
+    }
+    return result;
+}
+
+std::string metrics::toJson()
+{
+    std::ostringstream json;
+    json.precision(15);
+    json << "{\n  \"timestamp\": " << std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count() << ",\n";
+
+    json << "  \"stages\": {";
+    bool first = true;
+    for(const histogram *h : getHistograms()) {
+        json << (first ? "\n" : ",\n") << "    \"" << h->name << "\": {"
+             << "\"count\": " << h->getCount()
+             << ", \"mean_ns\": " << h->getMean()
+             << ", \"p50_ns\": " << h->getPercentile(0.5)
+             << ", \"p90_ns\": " << h->getPercentile(0.9)
+             << ", \"p99_ns\": " << h->getPercentile(0.99)
+             << ", \"max_ns\": " << h->getMax() << "}";
+        first = false;
+    }
+    json << "\n  },\n  \"counters\": {";
+    first = true;
+    for(const counter *c : getCounters()) {
+        json << (first ? "\n" : ",\n") << "    \"" << c->name << "\": " << c->get();
+        first = false;
+    }
+    for(const auto &p : getProbes()) {
+        json << (first ? "\n" : ",\n") << "    \"" << p.name << "\": " << p.value;
+        first = false;
+    }
+    json << "\n  }\n}\n";
+    return json.str();
+}
+
+// Prometheus text exposition format, the stages as summaries in seconds
+std::string metrics::toPrometheus()
+{
+    std::ostringstream text;
+    text << "# HELP pluto17_stage_seconds Processing time per block and stage\n"
+         << "# TYPE pluto17_stage_seconds summary\n";
+    for(const histogram *h : getHistograms()) {
+        for(double q : {0.5, 0.9, 0.99}) {
+            text << "pluto17_stage_seconds{stage=\"" << h->name << "\",quantile=\"" << q << "\"} " << h->getPercentile(q) * 1e-9 << "\n";
+        }
+        text << "pluto17_stage_seconds_sum{stage=\"" << h->name << "\"} " << h->getMean() * h->getCount() * 1e-9 << "\n"
+             << "pluto17_stage_seconds_count{stage=\"" << h->name << "\"} " << h->getCount() << "\n";
+    }
+    for(const counter *c : getCounters()) {
+        text << "# HELP pluto17_" << c->name << "_total " << c->help << "\n"
+             << "# TYPE pluto17_" << c->name << "_total counter\n"
+             << "pluto17_" << c->name << "_total " << c->get() << "\n";
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for(auto &p : probes) {
+        text << "# HELP pluto17_" << p.name << " " << p.help << "\n"
+             << "# TYPE pluto17_" << p.name << " gauge\n"
+             << "pluto17_" << p.name << " " << p.read() << "\n";
+    }
+    return text.str();
+}
+
+bool metrics::startDump(const std::string &path, double interval, format f)
+{
+    stopDump();
+    if(path.empty() || interval <= 0.0) {
+        std::cout << "ERROR: Metrics dump needs a path and an interval" << std::endl;
+        return false;
+    }
+    dumpPath = path;
+    dumpInterval = interval;
+    dumpFormat = f;
+    dumping = true;
+    dumpThread = std::thread(&metrics::dump, this);
+    return true;
+}
+
+void metrics::stopDump()
+{
+    dumping = false;
+    if(dumpThread.joinable()) {
+        dumpThread.join();
+    }
+}
+
+void metrics::dump()
+{
+    auto next = std::chrono::steady_clock::now();
+    while(dumping) {
+        if(std::chrono::steady_clock::now() < next) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(dumpInterval));
+
+        // Readers never see a half written file:
+        std::string temporary = dumpPath + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::trunc);
+            file << (dumpFormat == JSON ? toJson() : toPrometheus());
+            if(!file) {
+                std::cout << "ERROR: Cannot write metrics to " << temporary << std::endl;
+                dumping = false;
+                return;
+            }
+        }
+        std::rename(temporary.c_str(), dumpPath.c_str());
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Latency histogram with log-linear buckets (HDR style): 16 sub-buckets per
+// power of two, i.e. ~6 % resolution from 1 ns to hours in under 1000
+// buckets. Each histogram has one writer (the thread running that stage),
+// so recording is a handful of relaxed loads and stores, no locked
+// instructions. Readers may see a sample counted in one field but not yet
+// in another, which does not matter for statistics.
+class histogram {
+    public:
+    histogram(const std::string &name, const std::string &help);
+
+    void record(uint64_t ns)
+    {
+        bump(counts[index(ns)], 1);
+        bump(count, 1);
+        bump(sum, ns);
+        if(ns > max.load(std::memory_order_relaxed)) {
+            max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+    uint64_t getMax() const { return max.load(std::memory_order_relaxed); }
+    double getMean() const;
+    // Value below which the fraction p of the samples fall, in ns:
+    double getPercentile(double p) const;
+
+    const std::string name;
+    const std::string help;
+
+    private:
+    static constexpr int subBits = 4;
+    static constexpr int subBuckets = 1 << subBits;
+    static constexpr int bucketCount = (64 - subBits + 1) * subBuckets;
+
+    static void bump(std::atomic<uint64_t> &a, uint64_t v)
+    {
+        a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+    static int index(uint64_t v);
+    static double midpoint(int index);
+
+    std::atomic<uint64_t> counts[bucketCount];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+};
+
+// Monotonic event counter, any number of writers
+class counter {
+    public:
+    counter(const std::string &name, const std::string &help) : name(name), help(help), value(0) {}
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+    const std::string name;
+    const std::string help;
+
+    private:
+    std::atomic<uint64_t> value;
+};
+
+// Process wide registry. Stages look their histogram up once and keep the
+// reference, values that already live elsewhere (ring overruns, queue
+// depths, gap counters) are registered as probes and only read when a
+// snapshot is taken. Disabled, a timed scope costs one relaxed load.
+class metrics {
+    public:
+    enum format { JSON, PROMETHEUS };
+
+    static metrics& instance();
+
+    histogram& getHistogram(const std::string &name, const std::string &help = "");
+    counter& getCounter(const std::string &name, const std::string &help = "");
+    // Sampled at snapshot time, removed again with removeProbes(owner):
+    void addProbe(const void *owner, const std::string &name, const std::string &help, std::function<double()> probe);
+    void removeProbes(const void *owner);
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool on) { enabled = on; }
+
+    std::string toJson();
+    std::string toPrometheus();
+
+    // Rewrites `path` every `interval` seconds (atomically, via rename):
+    bool startDump(const std::string &path, double interval, format f);
+    void stopDump();
+    bool isDumping() { return dumping; }
+
+    // For the GUI:
+    std::vector<const histogram*> getHistograms();
+    std::vector<const counter*> getCounters();
+    struct probeValue {
+        std::string name;
+        double value;
+    };
+    std::vector<probeValue> getProbes();
+
+    private:
+    metrics();
+    ~metrics();
+    void dump();
+
+    struct probe {
+        const void *owner;
+        std::string name;
+        std::string help;
+        std::function<double()> read;
+    };
+
+    static std::atomic<bool> enabled;
+
+    // deques keep the references handed out stable:
+    std::mutex registryMutex;
+    std::deque<histogram> histograms;
+    std::deque<counter> counters;
+    std::vector<probe> probes;
+
+    std::thread dumpThread;
+    std::atomic<bool> dumping;
+    std::string dumpPath;
+    double dumpInterval;
+    format dumpFormat;
+};
+
+// Times the enclosing scope into a histogram while metrics are enabled
+class scopedTimer {
+    public:
+    explicit scopedTimer(histogram &h) : h(metrics::isEnabled() ? &h : nullptr)
+    {
+        if(this->h) {
+            begin = std::chrono::steady_clock::now();
+        }
+    }
+    ~scopedTimer()
+    {
+        if(h) {
+            h->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+        }
+    }
+
+    private:
+    histogram *h;
+    std::chrono::steady_clock::time_point begin;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#include "playback.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+playback::playback() :
+    fmt(CI16),
+    sampleRate(0.0),
+    frequency(0.0),
+    data(nullptr),
+    bytes(0),
+    samples(0),
+    position(0),
+    pendingSeek(-1),
+    loop(true),
+    realtime(true)
+{
+}
+
+playback::~playback()
+{
+    close();
+}
+
+static bool endsWith(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Picks a number or string value out of the SigMF JSON, enough for the
+// few flat keys needed here:
+static std::string metaValue(const std::string &json, const std::string &key)
+{
+    size_t k = json.find("\"" + key + "\"");
+    if(k == std::string::npos) {
+        return "";
+    }
+    size_t colon = json.find(':', k);
+    if(colon == std::string::npos) {
+        return "";
+    }
+    size_t begin = json.find_first_not_of(" \t\r\n\"", colon + 1);
+    size_t end = json.find_first_of(",}\"\r\n", begin);
+    if(begin == std::string::npos || end == std::string::npos) {
+        return "";
+    }
+    return json.substr(begin, end - begin);
+}
+
+bool playback::readMeta(const std::string &metaPath)
+{
+    std::ifstream file(metaPath);
+    if(!file) {
+        std::cout << "ERROR: Cannot read " << metaPath << std::endl;
+        return false;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    std::string json = ss.str();
+
+    std::string datatype = metaValue(json, "core:datatype");
+    if(datatype == "ci16_le") {
+        fmt = CI16;
+    } else if(datatype == "cf32_le") {
+        fmt = CF32;
+    } else {
+        std::cout << "ERROR: Unsupported SigMF datatype '" << datatype << "'" << std::endl;
+        return false;
+    }
+
+    std::string rate = metaValue(json, "core:sample_rate");
+    sampleRate = rate.empty() ? 0.0 : std::stod(rate);
+    std::string qrg = metaValue(json, "core:frequency");
+    frequency = qrg.empty() ? 0.0 : std::stod(qrg);
+    return true;
+}
+
+bool playback::open(const std::string &path, double defaultSampleRate)
+{
+    std::lock_guard<std::mutex> lock(mapMutex);
+    unmap();
+
+    std::string dataPath = path;
+    sampleRate = 0.0;
+    frequency = 0.0;
+    if(endsWith(path, ".sigmf-meta") || endsWith(path, ".sigmf-data") || endsWith(path, ".sigmf")) {
+        std::string base = path.substr(0, path.rfind(".sigmf"));
+        dataPath = base + ".sigmf-data";
+        if(!readMeta(base + ".sigmf-meta")) {
+            return false;
+        }
+    } else if(endsWith(path, ".cf32") || endsWith(path, ".cfile")) {
+        fmt = CF32;
+    } else {
+        fmt = CI16;
+    }
+
+    int fd = ::open(dataPath.c_str(), O_RDONLY);
+    if(fd < 0) {
+        std::cout << "ERROR: Cannot open " << dataPath << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size == 0) {
+        std::cout << "ERROR: " << dataPath << " is empty" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void *mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED) {
+        std::cout << "ERROR: Cannot map " << dataPath << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    madvise(mapped, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    if(sampleRate <= 0.0) {
+        sampleRate = defaultSampleRate;
+    }
+    this->path = dataPath;
+    data = static_cast<const char*>(mapped);
+    bytes = static_cast<size_t>(st.st_size);
+    samples = bytes / (fmt == CI16 ? 2 * sizeof(int16_t) : 2 * sizeof(float));
+    position = 0;
+    pendingSeek = -1;
+    return true;
+}
+
+void playback::close()
+{
+    std::lock_guard<std::mutex> lock(mapMutex);
+    unmap();
+}
+
+void playback::unmap()
+{
+    if(data != nullptr) {
+        munmap(const_cast<char*>(data.load()), bytes);
+        data = nullptr;
+    }
+    bytes = 0;
+    samples = 0;
+}
+
+size_t playback::read(int16_t *out, size_t count)
+{
+    std::lock_guard<std::mutex> lock(mapMutex);
+    if(data == nullptr || samples == 0) {
+        return 0;
+    }
+
+    int64_t target = pendingSeek.exchange(-1);
+    uint64_t p = target >= 0 ? static_cast<uint64_t>(target) : position.load();
+
+    size_t produced = 0;
+    while(produced < count) {
+        if(p >= samples) {
+            if(!loop) {
+                break;
+            }
+            p = 0;
+        }
+        size_t n = static_cast<size_t>(std::min<uint64_t>(count - produced, samples - p));
+        if(fmt == CI16) {
+            const int16_t *in = reinterpret_cast<const int16_t*>(data.load()) + 2 * p;
+            std::copy(in, in + 2 * n, out + 2 * produced);
+        } else {
+            // Quantize like the ADC, full scale is +-1.0:
+            const float *in = reinterpret_cast<const float*>(data.load()) + 2 * p;
+            for(size_t i = 0; i < 2 * n; i++) {
+                float v = std::clamp(in[i], -1.0f, 1.0f) * 32767.0f;
+                out[2 * produced + i] = static_cast<int16_t>(std::lrint(v));
+            }
+        }
+        produced += n;
+        p += n;
+    }
+    position = p;
+    return produced;
+}
+
+void playback::seek(double seconds)
+{
+    double target = std::clamp(seconds * sampleRate, 0.0, static_cast<double>(samples));
+    pendingSeek = static_cast<int64_t>(target);
+}
+
+double playback::getPosition()
+{
+    return sampleRate > 0.0 ? static_cast<double>(position.load()) / sampleRate : 0.0;
+}
+
+double playback::getLength()
+{
+    return sampleRate > 0.0 ? static_cast<double>(samples) / sampleRate : 0.0;
+}
@@ -0,0 +1,64 @@
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "samplesource.h"
+
+// Memory mapped IQ file source. Reads SigMF recordings (ci16_le / cf32_le,
+// sample rate and frequency from the .sigmf-meta), raw interleaved int16
+// (.cs16, .iq, .raw) and raw complex float (.cf32, .cfile) and hands them
+// out as interleaved int16 blocks, i.e. in the same format the Pluto
+// delivers. Seeking and looping are safe while another thread reads.
+class playback : public sampleSource {
+    public:
+    enum format { CI16, CF32 };
+
+    playback();
+    ~playback();
+
+    // Raw files carry no sample rate, they play at `defaultSampleRate`:
+    bool open(const std::string &path, double defaultSampleRate = 576'000.0);
+    void close();
+    bool isOpen() { return data != nullptr; }
+
+    // Fills up to `count` samples, returns the number of samples written,
+    // 0 at the end of the file (unless looping):
+    size_t read(int16_t *out, size_t count) override;
+
+    void seek(double seconds);
+    double getPosition();
+    double getLength();
+    void setLoop(bool loop) { this->loop = loop; }
+    bool getLoop() { return loop; }
+    void setRealtime(bool realtime) { this->realtime = realtime; }
+    bool getRealtime() override { return realtime; }
+
+    double getSampleRate() override { return sampleRate; }
+    // From the SigMF metadata, 0 if unknown:
+    double getFrequency() { return frequency; }
+    const std::string& getPath() { return path; }
+
+    private:
+    bool readMeta(const std::string &metaPath);
+    void unmap();
+
+    std::string path;
+    format fmt;
+    double sampleRate;
+    double frequency;
+
+    // open()/close() and read() run on different threads:
+    std::mutex mapMutex;
+    std::atomic<const char*> data;
+    size_t bytes;
+    uint64_t samples;
+    std::atomic<uint64_t> position;
+    std::atomic<int64_t> pendingSeek;
+    std::atomic<bool> loop;
+    std::atomic<bool> realtime;
+};
+
+#endif
@@ -1,178 +1,320 @@
 #include "pluto.h"
-
-pluto::pluto(uint64_t N) : N(N)
+#include "iqconvert.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+pluto::pluto(frequencyPlan *plan, uint64_t blockSize, unsigned kernelBuffers) :
+    plan(plan),
+    blockSize(blockSize),
+    kernelBuffers(kernelBuffers),
+    gaps(plan->getSampleRate(), blockSize, kernelBuffers),
+    synthetic(plan->getSampleRate())
 {
-    std::cout << "Pluto created" << std::endl;
+    std::cout << "Pluto created (IQ conversion: " << iqConvertKernel() << ")" << std::endl;
 
     connected = false;
     fakeConnected = false;
+    playingBack = false;
+    running = false;
+    source = nullptr;
+    poolBlocks = 0;
+    publishedSamples = 0;
+    sequence = 0;
 
     // For complex signals the sample rate is the same as the bandwidth
     // (Reason: for I nyquist holds and for Q as well)
-    sampleRate = 576'000; 
-    baseQrg = 10'489'750'000;
-    rxOffset = 9'749'975'946;
-    baseQrgRx = baseQrg - rxOffset;
+    sampleRate = static_cast<uint64_t>(plan->getSampleRate());
+    baseQrgRx = plan->getRxFrequency();
     std::cout << "baseQrgRx = " << baseQrgRx << std::endl;
-    baseQrgTx = double(2400000UL - 30UL);
-    bandwidthRx = 576'000;
+    baseQrgTx = plan->getCenterFrequency() - transponderShift;
+    bandwidthRx = sampleRate;
     bandwidthTx = 100'000;
     rxBuffer = nullptr;
     txBuffer = nullptr;
 
-    // Iniitialize Fake Samples:
-    double f = 210.9375; // Hz
-    phase = 0.0;
-    phaseIncrement = (2.0 * M_PI * f) / static_cast<double>(sampleRate);
-
-    fourier = new fft(N);
-    usb = new ssb(N);
-    sound = new audio(usb->out);
+    // The acquisition block size is fixed, the FFT size can change live:
+    N = plan->getN();
+    frameFill = 0;
+    fourier = new spectrumFft(N);
+    averager = new spectrumAverager(N);
+    detector = new signalDetector(plan, N);
+    usb = new ssb(plan->getSampleRate(), blockSize);
+    channels = new channelizer(plan->getSampleRate(), blockSize);
+    sound = new audio();
+    uplink = new transmitter(plan->getSampleRate(), blockSize);
+    carrier = 0;
+    mode = SINGLE;
+
+    // Consumers have to subscribe before the acquisition thread starts:
+    scratchBlock.resize(2 * blockSize);
+    spectrumRing = subscribe();
+    audioRing = subscribe();
+
+    // The recorder gets a deep ring (~3.6 s) to ride out disk stalls:
+    iqRing *recorderRing = subscribe(static_cast<size_t>(ceil(3.6 * sampleRate / blockSize)));
+    iqRecorder = new recorder(plan, recorderRing);
+
+    meter = new latencyMeter(subscribe(), plan->getSampleRate(), blockSize);
+    uplink->setLatencyMeter(meter);
+
+    tracker = new beaconTracker(subscribe(), plan, blockSize);
+    zoom = new zoomSpectrum(subscribe(), plan, blockSize);
+
+    // Queue depths and loss counters, only read for the stats panel/dumps:
+    metrics &registry = metrics::instance();
+    registry.addProbe(this, "spectrum_queue_blocks", "Blocks waiting for the spectrum", [this]() { return spectrumRing->size(); });
+    registry.addProbe(this, "audio_queue_blocks", "Blocks waiting for the demodulator", [this]() { return audioRing->size(); });
+    registry.addProbe(this, "recorder_queue_blocks", "Blocks waiting for the recorder", [recorderRing]() { return recorderRing->size(); });
+    registry.addProbe(this, "pool_blocks_in_use", "Pooled IQ blocks lent out", [this]() { return pool ? pool->getInUse() : 0; });
+    registry.addProbe(this, "published_samples", "Samples handed to the consumers", [this]() { return publishedSamples.load(); });
+    registry.addProbe(this, "overrun_blocks", "Blocks a consumer ring had to drop", [this]() { return getOverruns(); });
+    registry.addProbe(this, "dropped_samples", "Samples the kernel dropped", [this]() { return gaps.getDroppedSamples(); });
+    registry.addProbe(this, "gaps", "Gaps in the received stream", [this]() { return gaps.getGaps(); });
+    registry.addProbe(this, "acquisition_lag_seconds", "Received samples behind the wall clock", [this]() { return gaps.getLag(); });
+    registry.addProbe(this, "audio_buffered_seconds", "Audio queued for PortAudio", [this]() { return sound->getBufferedLatency(); });
+    registry.addProbe(this, "audio_underruns", "PortAudio callbacks without enough audio", [this]() { return sound->getUnderruns(); });
+    registry.addProbe(this, "audio_overruns", "Audio blocks dropped, too much queued", [this]() { return sound->getOverruns(); });
 }
 
-iio_scan_context* pluto::getScanContext()
+pluto::~pluto()
 {
-    return iio_create_scan_context(nullptr,0);
+    metrics::instance().removeProbes(this);
+    delete uplink;
+    stopAcquisition();
+    delete zoom;
+    delete tracker;
+    delete meter;
+    delete iqRecorder;
 }
 
-iio_context* pluto::getContext(iio_scan_context *scanContext)
+// Every ring can hold its own blocks in the worst case, plus the one each
+// consumer works on and the one being filled, so the pool never runs dry
+// before a ring overruns
+iqRing* pluto::subscribe(size_t depth)
 {
-    struct iio_context_info **info;
-    int ret = iio_scan_context_get_info_list(scanContext, &info);
-    return iio_create_context_from_uri("ip:192.168.178.85");
+    consumers.push_back(std::make_unique<iqRing>(depth));
+    poolBlocks += depth + 1;
+    return consumers.back().get();
 }
 
-iio_device* pluto::getDevice(iio_context* context)
+uint64_t pluto::getOverruns()
 {
-    return iio_context_find_device(context, "ad9361-phy");
+    uint64_t overruns = pool ? pool->getExhausted() : 0;
+    for(auto &ring : consumers) {
+        overruns += ring->getOverruns();
+    }
+    return overruns;
 }
 
-bool pluto::getStreamDevice(iio_context *context, iodev d, iio_device **device)
+void pluto::startAcquisition()
 {
-    if(d == TX) {
-        *device = iio_context_find_device(context, "cf-ad9361-dds-core-lpc");
-        return *device != nullptr;
-    } else if (d == RX) { 
-        *device = iio_context_find_device(context, "cf-ad9361-lpc");
-        return *device != nullptr;
+    if(running) {
+        return;
     }
-    return false;
+    if(!pool) {
+        pool = std::make_unique<blockPool>(blockSize, poolBlocks + 1);
+    }
+    running = true;
+    acquisitionThread = std::thread(&pluto::acquire, this);
+    demodulatorThread = std::thread(&pluto::demodulate, this);
 }
 
-bool pluto::configureChannel(iio_context *context, int64_t bandwidth, int64_t sampleRate, double baseQrg, std::string port, iodev type, int chid)
+void pluto::stopAcquisition()
 {
-    iio_channel *channel = nullptr;
-
-    if(!getPhyConfigChannel(context, type, chid, &channel)) {
-        return false;
+    running = false;
+    if(acquisitionThread.joinable()) {
+        acquisitionThread.join();
     }
-
-    writeToChannel(channel, "rf_port_select", port.c_str());
-    writeToChannel(channel, "rf_bandwidth", bandwidth);
-    writeToChannel(channel, "sampling_frequency", sampleRate);
-
-    if(type == TX) {
-        setTxPower(0.0);
-        setTxQrg(baseQrgRx); // TODO set TX QRG
-    } else {
-        writeToChannel(channel, "gain_control_mode", "slow_attack");
-        setRxQrg(baseQrgRx);
+    if(demodulatorThread.joinable()) {
+        demodulatorThread.join();
     }
-
-    return true;
 }
 
-// Finds AD9361 phy IIO configuration channel with id chid
-bool pluto::getPhyConfigChannel(iio_context *context, iodev d, int chid, iio_channel **channel) 
+// Runs on the acquisition thread and drains the Pluto as fast as it delivers
+void pluto::acquire()
 {
-    if(d == RX) {
-        *channel = iio_device_find_channel(getDevice(context), getChannelName("voltage", chid).c_str(), false);
-        return *channel != NULL;
-    } else if (d == TX) {
-        *channel = iio_device_find_channel(getDevice(context), getChannelName("voltage", chid).c_str(), true);
-        return *channel != NULL;
+    auto blockDuration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(blockSize) / static_cast<double>(sampleRate))
+    );
+    auto deadline = std::chrono::steady_clock::now();
+
+    while(running) {
+        sampleSource *s = source;
+        if(s == nullptr || !getSamples(s)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        if(!s->isPaced() && s->getRealtime()) {
+            // Do not catch up on time spent paused or running unpaced:
+            auto now = std::chrono::steady_clock::now();
+            deadline = std::max(deadline + blockDuration, now - 10 * blockDuration);
+            std::this_thread::sleep_until(deadline);
+        }
     }
-    return false;
 }
 
-std::string pluto::getChannelName(const char* type, int id) 
+// Runs on the demodulator thread, independent of the GUI frame rate, and
+// feeds the audio ring which PortAudio drains from its callback
+void pluto::demodulate()
 {
-    std::stringstream ss;
-    ss << type << id;
-    std::cout << ss.str() << std::endl;
-    return ss.str();
+    histogram &demodulateTime = metrics::instance().getHistogram("demodulate", "IQ conversion and SSB/channelizer per block");
+    histogram &audioTime = metrics::instance().getHistogram("audio_write", "Handing audio to the PortAudio ring");
+
+    while(running) {
+        iqBlock *slot = audioRing->readSlot();
+        if(slot == nullptr) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        iqBlock block = std::move(*slot);
+        audioRing->commitRead();
+
+        const float *audioOut;
+        unsigned int count;
+        {
+            scopedTimer timer(demodulateTime);
+            if(mode == CHANNELIZED) {
+                convertIq(block.samples(), blockSize, reinterpret_cast<float*>(channels->in.data()));
+                block.reset();
+                channels->setCorrection(plan->getCorrection());
+                count = channels->process(blockSize);
+                audioOut = channels->out.data();
+            } else {
+                convertIq(block.samples(), blockSize, reinterpret_cast<float*>(usb->in.data()));
+                block.reset();
+
+                // The carrier counts from the lower band edge, the SSB
+                // receiver expects the (drift corrected) offset from the center:
+                double offset = static_cast<double>(carrier) - static_cast<double>(sampleRate) / 2.0 + plan->getCorrection();
+                count = usb->demodulate(offset, blockSize);
+                audioOut = usb->out.data();
+            }
+        }
+
+        scopedTimer timer(audioTime);
+        sound->write(audioOut, count);
+    }
 }
 
-void pluto::writeToChannel(iio_channel *channel, std::string what, std::string val)
+// Fills a pooled block straight from the source and lends it to every
+// consumer
+bool pluto::getSamples(sampleSource *s)
 {
-    iio_channel_attr_write(channel, what.c_str(), val.c_str());
-}
+    // With every block still lent out (counted as overrun) the source is
+    // drained into scratch memory and the block is dropped:
+    iqBlock block = pool->acquire();
+    int16_t *samples = block.empty() ? scratchBlock.data() : pool->data(block);
+
+    auto begin = std::chrono::steady_clock::now();
+    size_t count = s->read(samples, blockSize);
+    if(count == 0) {
+        return false;
+    }
+    auto end = std::chrono::steady_clock::now();
 
-void pluto::writeToChannel(iio_channel *channel, std::string what, double val)
-{
-    iio_channel_attr_write_double(channel, what.c_str(), val);
+    // Samples lost in the kernel show up as a sequence gap, just like
+    // blocks a ring had to drop:
+    if(s->isPaced()) {
+        uint64_t lost = gaps.update(count, end - begin);
+        sequence += lost / blockSize;
+    }
+    if(block.empty()) {
+        // The dropped block leaves a gap in the sequence too:
+        sequence++;
+        return true;
+    }
+    publish(block, count, end, !s->getRealtime());
+    return true;
 }
 
-void pluto::writeToChannel(iio_channel *channel, std::string what, int64_t val)
+// Hands a view of the block to every consumer ring, a full ring counts as
+// overrun. With `wait` a full ring is waited for instead (unpaced file
+// playback, the slowest consumer sets the pace).
+void pluto::publish(const iqBlock &block, size_t count, std::chrono::steady_clock::time_point time, bool wait)
 {
-    iio_channel_attr_write_longlong(channel, what.c_str(), val);
-}
-
-bool pluto::setTxPower(double power) {
-    struct iio_channel *channel = nullptr;
-    if (!getPhyConfigChannel(context, TX, 0, &channel)) {
-        return false;
+    count = std::min<size_t>(count, blockSize);
+    pool->finish(block, count, sequence, time);
+    for(auto &ring : consumers) {
+        iqBlock *slot = ring->writeSlot();
+        while(slot == nullptr && wait && running) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            slot = ring->writeSlot();
+        }
+        if(slot == nullptr) {
+            continue;
+        }
+        *slot = block;
+        ring->commitWrite();
     }
+    sequence++;
+    publishedSamples += count;
+}
 
-    writeToChannel(channel, "hardwaregain", power);
-    return true;
+iio_scan_context* pluto::getScanContext()
+{
+    return iio_create_scan_context(nullptr,0);
 }
 
-bool pluto::setTxQrg(int64_t qrg)
+iio_context* pluto::getContext(iio_scan_context *scanContext)
 {
-    struct iio_channel *channel = nullptr;
-    if (!getLocalOscillatorChannel(context, TX, &channel)) {
-        return false;
-    }
-    writeToChannel(channel, "frequency", qrg);
-    return true;
+    struct iio_context_info **info;
+    int ret = iio_scan_context_get_info_list(scanContext, &info);
+    return iio_create_context_from_uri("ip:192.168.178.85");
 }
 
-bool pluto::setRxQrg(int64_t qrg)
+bool pluto::getStreamDevice(iio_context *context, iodev d, iio_device **device)
 {
-    struct iio_channel *channel = nullptr;
-    if (!getLocalOscillatorChannel(context, RX, &channel)) {
-        return false;
+    if(d == TX) {
+        *device = iio_context_find_device(context, "cf-ad9361-dds-core-lpc");
+        return *device != nullptr;
+    } else if (d == RX) { 
+        *device = iio_context_find_device(context, "cf-ad9361-lpc");
+        return *device != nullptr;
     }
-    writeToChannel(channel, "frequency", qrg);
-    return true;
+    return false;
 }
 
-// Finds AD9361 local oscillator IIO configuration channels 
-bool pluto::getLocalOscillatorChannel(iio_context *context, iodev d, iio_channel **channel) 
+bool pluto::configureChannel(int64_t bandwidth, int64_t sampleRate, double baseQrg, std::string port, iodev type)
 {
-    if(d == RX) {
-        *channel = iio_device_find_channel(getDevice(context), getChannelName("altvoltage", 0).c_str(), true);
-        return *channel != NULL;
-    } else if (d == TX) {
-        *channel = iio_device_find_channel(getDevice(context), getChannelName("altvoltage", 1).c_str(), true); 
-        return *channel != NULL;
+    retuneRequest request;
+    if(type == TX) {
+        if(!control.configureTx(bandwidth, sampleRate, port)) {
+            return false;
+        }
+        // Attenuated until the transmitter keys up:
+        request.txGain = transmitter::minPower;
+        request.txFrequency = static_cast<int64_t>(std::llround(baseQrg));
+    } else {
+        if(!control.configureRx(bandwidth, sampleRate, port, "slow_attack")) {
+            return false;
+        }
+        request.rxFrequency = static_cast<int64_t>(std::llround(baseQrg));
     }
-    return false;
+    return control.retune(request).ok;
 }
 
-std::string pluto::getChannelNameModify(const char* type, int id, char modify) 
+void pluto::tune(double centerFrequency, deviceControl::callback done)
 {
-    std::stringstream ss;
-    ss << type << id << "_" << modify;
-    std::cout << ss.str() << std::endl;
-    return ss.str();
+    retuneRequest request;
+    request.rxFrequency = static_cast<int64_t>(std::llround(centerFrequency - plan->getLoOffset()));
+    // The uplink LO keeps sitting under the matching uplink band center:
+    request.txFrequency = static_cast<int64_t>(std::llround(centerFrequency - transponderShift));
+    control.post(request, [this, centerFrequency, done](const retuneResult &result) {
+        if(result.ok) {
+            plan->setCenterFrequency(centerFrequency);
+        }
+        if(done) {
+            done(result);
+        }
+    });
 }
 
 bool pluto::getStreamChannel(iio_context *context, iodev d, iio_device *device, int chid, iio_channel **channel) {
-    *channel = iio_device_find_channel(device, getChannelName("voltage", chid).c_str(), d == TX);
+    *channel = iio_device_find_channel(device, ("voltage" + std::to_string(chid)).c_str(), d == TX);
     if (!*channel)
-        *channel = iio_device_find_channel(device, getChannelName("altvoltage", chid).c_str(), d == TX);
+        *channel = iio_device_find_channel(device, ("altvoltage" + std::to_string(chid)).c_str(), d == TX);
     return *channel != NULL;
 }
 
@@ -207,12 +349,18 @@ bool pluto::connect()
     }
 
 
-    if(!configureChannel(context, bandwidthRx, sampleRate, baseQrg, "A_BALANCED", RX, 0)) {
+    // The phy channels are looked up once, retunes write to them directly:
+    if(!control.open(context)) {
+        std::cout << "ERROR: Cannot connect to Pluto: Unable to find the ad9361-phy channels" << std::endl;
+        return false;
+    }
+
+    if(!configureChannel(bandwidthRx, sampleRate, baseQrgRx, "A_BALANCED", RX)) {
         std::cout << "ERROR: Cannot connect to Pluto: Unable to configure RX channel" << std::endl;
         return false;
     }
 
-    if(!configureChannel(context, bandwidthTx, sampleRate, baseQrg, "A", TX, 0)) {
+    if(!configureChannel(bandwidthTx, sampleRate, baseQrgTx, "A", TX)) {
         std::cout << "ERROR: Cannot connect to Pluto: Unable to configure RX channel" << std::endl;
         return false;
     }
@@ -233,86 +381,198 @@ bool pluto::connect()
     iio_channel_enable(tx0i);
     iio_channel_enable(tx0q);
 
-    rxBuffer = iio_device_create_buffer(rx, N, false);
+    // More kernel buffers bridge longer stalls of the acquisition thread
+    // before the hardware has to drop samples:
+    if(iio_device_set_kernel_buffers_count(rx, kernelBuffers) < 0) {
+        std::cout << "WARNING: Cannot set " << kernelBuffers << " kernel buffers" << std::endl;
+    }
+
+    rxBuffer = iio_device_create_buffer(rx, blockSize, false);
     if (!rxBuffer) {
         std::cout << "Could not create RX buffer" << std::endl;
         return false;
     }
 
-    txBuffer = iio_device_create_buffer(tx, N, false);
+    // The transmitter keeps this many blocks queued for the DAC:
+    if(iio_device_set_kernel_buffers_count(tx, transmitter::kernelBuffers) < 0) {
+        std::cout << "WARNING: Cannot set " << transmitter::kernelBuffers << " TX kernel buffers" << std::endl;
+    }
+
+    txBuffer = iio_device_create_buffer(tx, blockSize, false);
     if (!txBuffer) {
         std::cout << "Could not create TX buffer" << std::endl;
         return false;
     }
 
     //ad9361_set_bb_rate()
-    ad9361_set_bb_rate(getDevice(context), round(sampleRate));
+    ad9361_set_bb_rate(control.getPhy(), round(sampleRate));
 
+    device = std::make_unique<iioSource>(rxBuffer, rx0i, static_cast<double>(sampleRate));
+    gaps.reset(kernelBuffers);
+    source = device.get();
     connected = true;
+    startAcquisition();
+
+    if(!uplink->start(txBuffer, tx0i, [this](double dB) { return control.setTxGain(dB); })) {
+        std::cout << "WARNING: Transmitting is disabled" << std::endl;
+    }
     return true;
 }
 
-bool pluto::fakeConnect() {
+bool pluto::fakeConnect(const std::string &scenario) {
+    if(!synthetic.load(scenario)) {
+        return false;
+    }
+    source = &synthetic;
     fakeConnected = true;
+    startAcquisition();
     return true;
 }
 
-bool pluto::getFakeSamples(uint64_t carrier)
+bool pluto::playbackConnect(const std::string &path)
 {
-    for(int i = 0; i < N; ++i) {
-        fourier->in[i][0] = cos(phase) + static_cast<double>(rand()) / RAND_MAX * 0.1;
-        fourier->in[i][1] = sin(phase) + static_cast<double>(rand()) / RAND_MAX * 0.1;
-        phase += phaseIncrement;
-        if(phase >= 2.0*M_PI)
-            phase -= 2.0*M_PI;
+    playingBack = false;
+    if(!player.open(path, static_cast<double>(sampleRate))) {
+        return false;
     }
 
-    fourier->processSamples();
+    if(player.getSampleRate() != static_cast<double>(sampleRate)) {
+        std::cout << "WARNING: " << path << " was recorded at " << player.getSampleRate()
+                  << " S/s, playing at " << sampleRate << " S/s" << std::endl;
+    }
+    if(player.getFrequency() > 0.0) {
+        plan->setCenterFrequency(player.getFrequency());
+    }
 
+    source = &player;
+    playingBack = true;
+    startAcquisition();
     return true;
 }
 
-bool pluto::getSamples(uint64_t carrier)
+// Runs on the GUI thread and consumes the spectrum ring at frame rate
+bool pluto::processSamples(uint64_t carrier)
 {
-    ssize_t numberOfRxBytes = iio_buffer_refill(rxBuffer);
+    this->carrier = carrier;
+
+    // The echo sits where the channel of the uplink's sideband would be:
+    double pitch = (ssb::lowCut + ssb::highCut) / 2.0;
+    double offset = static_cast<double>(carrier) - static_cast<double>(sampleRate) / 2.0 + plan->getCorrection();
+    meter->setFrequency(uplink->getSideband() == ssb::USB ? offset + pitch : offset - pitch);
+
+    // A drifting Pluto reference is off by the same ppm in both directions,
+    // the uplink error scales with its LO over the RX LO:
+    double txCorrection = 0.0;
+    if(tracker->isTxCorrected()) {
+        txCorrection = plan->getCorrection() * (plan->getCenterFrequency() - transponderShift) / plan->getRxFrequency();
+    }
+    uplink->setCorrection(txCorrection);
+
+    // Follow FFT size changes of the frequency plan:
+    if(plan->getN() != N) {
+        N = plan->getN();
+        fourier->resize(N);
+        averager->resize(N);
+        detector->resize(N);
+        frameFill = 0;
+    }
 
-    if(numberOfRxBytes < 0) {
-        std::cout << "ERROR: Error in Refilling rxBuffer" << std::endl;
-        return false;
+    static histogram &convertTime = metrics::instance().getHistogram("iq_convert", "int16 to float for the spectrum");
+    static histogram &averageTime = metrics::instance().getHistogram("average", "Spectrum averaging");
+    static histogram &detectTime = metrics::instance().getHistogram("detect", "Signal detector");
+    static counter &frames = metrics::instance().getCounter("spectrum_frames", "FFT frames processed");
+
+    // Blocks are cut into (or gathered to) frames of N samples, every frame
+    // goes through the FFT and into the averager:
+    bool processed = false;
+    while(iqBlock *slot = spectrumRing->readSlot()) {
+        iqBlock block = std::move(*slot);
+        spectrumRing->commitRead();
+
+        uint64_t offset = 0;
+        while(offset < blockSize) {
+            uint64_t count = std::min(N - frameFill, blockSize - offset);
+            {
+                scopedTimer timer(convertTime);
+                convertIq(
+                    block.samples() + 2 * offset,
+                    count,
+                    reinterpret_cast<spectrumSample*>(fourier->in) + 2 * frameFill
+                );
+            }
+            offset += count;
+            frameFill += count;
+
+            if(frameFill == N) {
+                fourier->processSamples();
+                {
+                    scopedTimer timer(averageTime);
+                    averager->add(fourier->getSpectrum());
+                }
+                {
+                    scopedTimer timer(detectTime);
+                    detector->process(fourier->getSpectrum());
+                }
+                frames.add();
+                frameFill = 0;
+                processed = true;
+            }
+        }
     }
+    return processed;
+}
 
-    uint8_t *start = (uint8_t *)iio_buffer_first(rxBuffer, rx0i);
-    uint8_t *end = (uint8_t *)iio_buffer_end(rxBuffer);
+spectrumFft* pluto::getFourier()
+{
+    return fourier;
+}
 
-    // READ: Get pointers to RX buf and read IQ from RX buf port 0
-    void *p_dat;
-    ptrdiff_t p_inc = iio_buffer_step(rxBuffer);
-    void *p_end = iio_buffer_end(rxBuffer);
-    unsigned int counter = 0;
-    for (p_dat = (char *)iio_buffer_first(rxBuffer, rx0i); p_dat < p_end; p_dat = static_cast<char*>(p_dat) + p_inc) {
-        const int16_t i = ((int16_t*)p_dat)[0]; // Real (I)
-        const int16_t q = ((int16_t*)p_dat)[1]; // Imag (Q)
+spectrumAverager* pluto::getAverager()
+{
+    return averager;
+}
 
-        fourier->in[counter][0] = (static_cast<double>(i)/32768.0f);
-        fourier->in[counter][1] = (static_cast<double>(q)/32768.0f);
+signalDetector* pluto::getDetector()
+{
+    return detector;
+}
 
-        //usb->in[counter] = std::complex<float>(
-        //    static_cast<float>(i)/32768.0f,
-        //    static_cast<double>(q)/32768.0f
-        //);
-        
-        counter++;
-    }
+audio* pluto::getAudio()
+{
+    return sound;
+}
+
+playback* pluto::getPlayback()
+{
+    return &player;
+}
 
-    fourier->processSamples();
-    //usb->demodulate(carrier);
-    //sound->playback(N);
+transmitter* pluto::getTransmitter()
+{
+    return uplink;
+}
 
-    return true;
+latencyMeter* pluto::getLatencyMeter()
+{
+    return meter;
 }
 
-fftw_complex* pluto::getFftBuffer()
+beaconTracker* pluto::getTracker()
 {
-    return fourier->out;
+    return tracker;
 }
 
+zoomSpectrum* pluto::getZoom()
+{
+    return zoom;
+}
+
+channelizer* pluto::getChannelizer()
+{
+    return channels;
+}
+
+recorder* pluto::getRecorder()
+{
+    return iqRecorder;
+}
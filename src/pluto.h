@@ -7,51 +7,110 @@
 #include <ad9361.h>
 #include <fftw3.h>
 #include <complex>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
 #include "dsp.h"
+#include "audio.h"
+#include "channelizer.h"
+#include "recorder.h"
+#include "transmitter.h"
+#include "latency.h"
+#include "tracker.h"
+#include "zoom.h"
+#include "playback.h"
+#include "generator.h"
+#include "samplesource.h"
+#include "iiosource.h"
+#include "gapdetector.h"
+#include "ringbuffer.h"
+#include "iqblock.h"
+#include "averager.h"
+#include "detector.h"
+#include "frequencyplan.h"
+#include "devicecontrol.h"
 
 class pluto {
   public:
     
-    pluto(uint64_t N = 4096);
+    // The acquisition block size is independent of the FFT size, the
+    // kernel buffers (each blockSize samples) ride out consumer hiccups:
+    pluto(frequencyPlan *plan, uint64_t blockSize = 8192, unsigned kernelBuffers = 4);
+    ~pluto();
 
     enum iodev { RX, TX };
 
+    // SINGLE demodulates the carrier at the full rate, CHANNELIZED runs any
+    // number of VFOs off a polyphase channelizer:
+    enum receiverMode { SINGLE, CHANNELIZED };
+    void setReceiverMode(receiverMode m) { mode = m; }
+    receiverMode getReceiverMode() { return mode; }
+
     bool connect();
-    bool fakeConnect();
+    // Synthetic band, an empty path uses the built-in scenario:
+    bool fakeConnect(const std::string &scenario = "");
+    bool playbackConnect(const std::string &path);
     bool isConnected() { return connected; }
     bool isFakeConnected() { return fakeConnected; }
-    bool getSamples(uint64_t carrier);
-    bool getFakeSamples(uint64_t carrier);
+    bool isPlayingBack() { return playingBack; }
+    bool processSamples(uint64_t carrier);
     uint64_t getN();
 
-    fftw_complex* getFftBuffer();
+    // Moves the band center, the RX and TX LOs are retuned on the control
+    // thread and the plan follows once they took the new frequency.
+    // Callable from any thread:
+    void tune(double centerFrequency, deviceControl::callback done = nullptr);
+    deviceControl* getControl() { return &control; }
+
+    // Acquisition:
+    iqRing* subscribe(size_t depth = 64);
+    uint64_t getOverruns();
+    uint64_t getPublishedSamples() { return publishedSamples; }
+    uint64_t getBlockSize() { return blockSize; }
+    // Takes effect on the next connect():
+    void setKernelBuffers(unsigned count) { kernelBuffers = count; }
+    unsigned getKernelBuffers() { return kernelBuffers; }
+    gapDetector* getGapDetector() { return &gaps; }
+
+    spectrumFft* getFourier();
+    spectrumAverager* getAverager();
+    signalDetector* getDetector();
+    audio* getAudio();
+    channelizer* getChannelizer();
+    recorder* getRecorder();
+    playback* getPlayback();
+    transmitter* getTransmitter();
+    latencyMeter* getLatencyMeter();
+    beaconTracker* getTracker();
+    zoomSpectrum* getZoom();
 
   private:
 
+    // Acquisition thread (producer side of the rings):
+    void startAcquisition();
+    void stopAcquisition();
+    void acquire();
+    bool getSamples(sampleSource *s);
+    void publish(const iqBlock &block, size_t count, std::chrono::steady_clock::time_point time, bool wait = false);
+
+    // Demodulator thread (consumer of the audio ring):
+    void demodulate();
+
     // Methods that encapsulate pluto access (i.e. driver):
     iio_scan_context* getScanContext();
     iio_context* getContext(iio_scan_context *scanContext);
-    iio_device* getDevice(iio_context* context);
     bool getStreamDevice(iio_context *context, iodev d, iio_device **device);
-    bool configureChannel(iio_context *context, int64_t bandwidth, int64_t sampleRate, double baseQrg, std::string port, iodev type, int chid);
-    bool getPhyConfigChannel(iio_context *context, iodev d, int chid, iio_channel **channel);
-    std::string getChannelName(const char* type, int id);
-    void writeToChannel(iio_channel *channel, std::string what, std::string val);
-    void writeToChannel(iio_channel *channel, std::string what, double val);
-    void writeToChannel(iio_channel *channel, std::string what, int64_t val);
-    bool setTxPower(double power);
-    bool setTxQrg(int64_t qrg);
-    bool setRxQrg(int64_t qrg);
-    bool getLocalOscillatorChannel(iio_context *context, iodev d, iio_channel **channel);
-    std::string getChannelNameModify(const char* type, int id, char modify);
+    bool configureChannel(int64_t bandwidth, int64_t sampleRate, double baseQrg, std::string port, iodev type);
     bool getStreamChannel(iio_context *context, iodev d, iio_device *device, int chid, iio_channel **channel);
 
     // Config:
+    frequencyPlan *plan;
     uint64_t sampleRate;
-    uint64_t N;
+    uint64_t blockSize; // Samples per acquired block
+    std::atomic<unsigned> kernelBuffers;
+    uint64_t N; // Current FFT size of the spectrum consumer
     uint64_t lnbReference;
-    uint64_t baseQrg; 
-    uint64_t rxOffset; 
     double baseQrgTx;
     double baseQrgRx;
     int64_t bandwidthRx;
@@ -60,6 +119,9 @@ class pluto {
     // Context:
     iio_context *context;
 
+    // ad9361-phy attributes (LOs, gains, filters), resolved at connect:
+    deviceControl control;
+
     // Streaming devices:
     iio_device *tx;
     iio_device *rx;
@@ -75,21 +137,67 @@ class pluto {
     iio_channel *tx0q;
 
     // Status: 
-    bool connected;
-    bool fakeConnected;
+    std::atomic<bool> connected;
+    std::atomic<bool> fakeConnected;
+    std::atomic<bool> playingBack;
+
+    // Acquisition, every consumer ring gets a view of the same pooled block:
+    std::thread acquisitionThread;
+    std::atomic<bool> running;
+    std::atomic<sampleSource*> source;
+    std::unique_ptr<iioSource> device;
+    std::unique_ptr<blockPool> pool;
+    size_t poolBlocks;
+    uint64_t sequence;
+    std::atomic<uint64_t> publishedSamples;
+    std::vector<std::unique_ptr<iqRing>> consumers;
+    gapDetector gaps;
+    iqRing *spectrumRing;
+    uint64_t frameFill;
+    std::vector<int16_t> scratchBlock;
+
+    // Demodulation:
+    std::thread demodulatorThread;
+    iqRing *audioRing;
+    std::atomic<uint64_t> carrier;
+    std::atomic<receiverMode> mode;
 
     // Furier Wrapper:
-    fft *fourier;
+    spectrumFft *fourier;
+    spectrumAverager *averager;
+    signalDetector *detector;
 
     // SSB Wrapper:
     ssb *usb;
 
+    // Raw IQ recorder:
+    recorder *iqRecorder;
+
+    // Multi VFO receiver:
+    channelizer *channels;
+
     // Audio Wrapper:
     audio *sound;
 
+    // SSB uplink:
+    transmitter *uplink;
+
+    // Round trip measurement, has its own ring:
+    latencyMeter *meter;
+
+    // LNB drift from the beacon, has its own ring:
+    beaconTracker *tracker;
+    // Zoom FFT around the VFO, has its own ring:
+    zoomSpectrum *zoom;
+
+    // QO-100 uplink = downlink - transponderShift:
+    static constexpr double transponderShift = 8'089'500'000.0;
+
+    // File playback:
+    playback player;
+
     // Fake Samples:
-    double phase;
-    double phaseIncrement;
+    generator synthetic;
 
 };
 
@@ -0,0 +1,255 @@
+#include "recorder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+recorder::recorder(frequencyPlan *plan, iqRing *ring) :
+    plan(plan),
+    ring(ring),
+    running(true),
+    recording(false),
+    stopRequested(false),
+    fd(-1),
+    chunkFill(0),
+    expectedSequence(0),
+    firstBlock(true),
+    samples(0),
+    droppedSamples(0),
+    stalls(0),
+    lastLatency(0.0),
+    maxLatency(0.0),
+    highWater(0)
+{
+    chunk = static_cast<int16_t*>(std::aligned_alloc(alignment, chunkSize));
+    writer = std::thread(&recorder::run, this);
+}
+
+recorder::~recorder()
+{
+    stop();
+    running = false;
+    if(writer.joinable()) {
+        writer.join();
+    }
+    std::free(chunk);
+}
+
+bool recorder::start(const std::string &basename)
+{
+    if(recording) {
+        std::cout << "ERROR: Recorder is still busy with " << this->basename << std::endl;
+        return false;
+    }
+
+    std::string path = basename + ".sigmf-data";
+#ifdef O_DIRECT
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if(fd < 0 && errno == EINVAL) {
+        // File system without direct I/O (e.g. tmpfs):
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+#else
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if(fd < 0) {
+        std::cout << "ERROR: Cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+#ifdef F_NOCACHE
+    fcntl(fd, F_NOCACHE, 1);
+#endif
+
+    // ISO 8601 UTC time of the first sample for the SigMF captures:
+    auto now = std::chrono::system_clock::now();
+    std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+    auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::gmtime(&seconds), "%Y-%m-%dT%H:%M:%S") << "." << std::setw(3) << std::setfill('0') << milliseconds << "Z";
+
+    this->basename = basename;
+    datetime = ss.str();
+    chunkFill = 0;
+    firstBlock = true;
+    captures.clear();
+    gaps.clear();
+    samples = 0;
+    droppedSamples = 0;
+    stalls = 0;
+    lastLatency = 0.0;
+    maxLatency = 0.0;
+    highWater = 0;
+    stopRequested = false;
+    recording = true;
+    return true;
+}
+
+void recorder::stop()
+{
+    if(recording) {
+        stopRequested = true;
+    }
+}
+
+std::string recorder::getBasename()
+{
+    return basename;
+}
+
+// Writer thread: drains the ring all the time (discarding while idle, so
+// the ring does not report overruns) and writes while recording
+void recorder::run()
+{
+    while(running) {
+        iqBlock *slot = ring->readSlot();
+        if(slot == nullptr) {
+            if(recording && stopRequested) {
+                finish();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        size_t fill = ring->size();
+        iqBlock block = std::move(*slot);
+        ring->commitRead();
+        if(recording) {
+            highWater = std::max<size_t>(highWater, fill);
+            consume(block);
+        }
+    }
+    if(recording) {
+        finish();
+    }
+}
+
+void recorder::consume(const iqBlock &block)
+{
+    uint64_t count = block.getCount();
+
+    // Sequence gaps are blocks the ring had to drop:
+    if(firstBlock) {
+        firstBlock = false;
+        captures.push_back({0, plan->getCenterFrequency()});
+    } else if(block.getSequence() != expectedSequence) {
+        uint64_t dropped = (block.getSequence() - expectedSequence) * count;
+        gaps.push_back({samples, dropped});
+        droppedSamples += dropped;
+    }
+    expectedSequence = block.getSequence() + 1;
+
+    // Retuning starts a new capture segment:
+    if(plan->getCenterFrequency() != captures.back().frequency) {
+        captures.push_back({samples, plan->getCenterFrequency()});
+    }
+
+    const char *data = reinterpret_cast<const char*>(block.samples());
+    size_t bytes = 2 * count * sizeof(int16_t);
+    while(bytes > 0) {
+        size_t n = std::min(bytes, chunkSize - chunkFill);
+        std::memcpy(reinterpret_cast<char*>(chunk) + chunkFill, data, n);
+        chunkFill += n;
+        data += n;
+        bytes -= n;
+        if(chunkFill == chunkSize && !flush(false)) {
+            finish();
+            return;
+        }
+    }
+    samples += count;
+}
+
+// Writes the chunk, the final (partial) one without O_DIRECT as its size
+// is not aligned
+bool recorder::flush(bool final)
+{
+#ifdef O_DIRECT
+    if(final) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+    }
+#endif
+    auto begin = std::chrono::steady_clock::now();
+    const char *data = reinterpret_cast<const char*>(chunk);
+    size_t remaining = chunkFill;
+    while(remaining > 0) {
+        ssize_t written = ::write(fd, data, remaining);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            std::cout << "ERROR: Recording to " << basename << " failed: " << std::strerror(errno) << std::endl;
+            chunkFill = 0;
+            return false;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    chunkFill = 0;
+
+    double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    lastLatency = latency;
+    maxLatency = std::max<double>(maxLatency, latency);
+    if(latency > stallThreshold) {
+        stalls++;
+    }
+    return true;
+}
+
+void recorder::finish()
+{
+    flush(true);
+    ::close(fd);
+    fd = -1;
+    writeMeta();
+    stopRequested = false;
+    recording = false;
+}
+
+bool recorder::writeMeta()
+{
+    std::string path = basename + ".sigmf-meta";
+    std::ofstream meta(path);
+    if(!meta) {
+        std::cout << "ERROR: Cannot write " << path << std::endl;
+        return false;
+    }
+
+    meta << std::setprecision(15);
+    meta << "{\n";
+    meta << "    \"global\": {\n";
+    meta << "        \"core:datatype\": \"ci16_le\",\n";
+    meta << "        \"core:sample_rate\": " << plan->getSampleRate() << ",\n";
+    meta << "        \"core:version\": \"1.0.0\",\n";
+    meta << "        \"core:recorder\": \"pluto17\",\n";
+    meta << "        \"core:hw\": \"ADALM-Pluto\"\n";
+    meta << "    },\n";
+    meta << "    \"captures\": [\n";
+    for(size_t i = 0; i < captures.size(); i++) {
+        meta << "        {\n";
+        meta << "            \"core:sample_start\": " << captures[i].sampleStart << ",\n";
+        meta << "            \"core:frequency\": " << captures[i].frequency;
+        if(i == 0) {
+            meta << ",\n            \"core:datetime\": \"" << datetime << "\"";
+        }
+        meta << "\n        }" << (i + 1 < captures.size() ? "," : "") << "\n";
+    }
+    meta << "    ],\n";
+    meta << "    \"annotations\": [\n";
+    for(size_t i = 0; i < gaps.size(); i++) {
+        meta << "        {\n";
+        meta << "            \"core:sample_start\": " << gaps[i].sampleStart << ",\n";
+        meta << "            \"core:sample_count\": 0,\n";
+        meta << "            \"core:comment\": \"" << gaps[i].count << " samples dropped before this sample\"\n";
+        meta << "        }" << (i + 1 < gaps.size() ? "," : "") << "\n";
+    }
+    meta << "    ]\n";
+    meta << "}\n";
+    return true;
+}
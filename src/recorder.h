@@ -0,0 +1,87 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frequencyplan.h"
+#include "ringbuffer.h"
+#include "iqblock.h"
+
+// Raw IQ recorder writing SigMF (ci16_le data plus a JSON meta file).
+// A writer thread drains its own subscriber ring, so the int16 samples go
+// from the iio buffer to disk untouched and acquisition never waits for
+// the disk: the ring absorbs write stalls, blocks lost to an overflowing
+// ring are counted and annotated in the metadata. Blocks are gathered into
+// page aligned chunks which are written with O_DIRECT (F_NOCACHE on
+// macOS), so hours of recording do not churn the page cache.
+class recorder {
+    public:
+    recorder(frequencyPlan *plan, iqRing *ring);
+    ~recorder();
+
+    // Records to <basename>.sigmf-data and <basename>.sigmf-meta:
+    bool start(const std::string &basename);
+    void stop();
+    bool isRecording() { return recording; }
+    std::string getBasename();
+
+    uint64_t getSamples() { return samples; }
+    uint64_t getDroppedSamples() { return droppedSamples; }
+    uint64_t getStalls() { return stalls; }
+    double getLastLatency() { return lastLatency; }
+    double getMaxLatency() { return maxLatency; }
+    size_t getHighWater() { return highWater; }
+    size_t getRingCapacity() { return ring->capacity(); }
+
+    static constexpr size_t chunkSize = 1 << 20; // Bytes per write
+    static constexpr size_t alignment = 4096;
+    static constexpr double stallThreshold = 0.1; // s
+
+    private:
+    void run();
+    void consume(const iqBlock &block);
+    bool flush(bool final);
+    void finish();
+    bool writeMeta();
+
+    frequencyPlan *plan;
+    iqRing *ring;
+    std::thread writer;
+    std::atomic<bool> running;
+
+    // Recording state. start() sets it up while the writer thread is idle,
+    // stop() only raises a flag, the writer thread finishes the files:
+    std::atomic<bool> recording;
+    std::atomic<bool> stopRequested;
+    int fd;
+    std::string basename;
+    std::string datetime;
+    int16_t *chunk;
+    size_t chunkFill; // Bytes
+    uint64_t expectedSequence;
+    bool firstBlock;
+
+    struct capture {
+        uint64_t sampleStart;
+        double frequency;
+    };
+    struct gap {
+        uint64_t sampleStart;
+        uint64_t count;
+    };
+    std::vector<capture> captures;
+    std::vector<gap> gaps;
+
+    // Statistics:
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> droppedSamples;
+    std::atomic<uint64_t> stalls;
+    std::atomic<double> lastLatency;
+    std::atomic<double> maxLatency;
+    std::atomic<size_t> highWater;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "reducer.h"
+#include <algorithm>
+#include <cmath>
+
+void spectrumReducer::build(const float *spectrum, uint64_t N)
+{
+    // (Re)allocate the levels only when the size changes:
+    if(N != this->N) {
+        this->N = N;
+        minLevels.clear();
+        maxLevels.clear();
+        for(uint64_t size = N; size > 0; size = (size > 1) ? (size + 1) / 2 : 0) {
+            minLevels.emplace_back(size);
+            maxLevels.emplace_back(size);
+        }
+    }
+
+    std::copy(spectrum, spectrum + N, minLevels[0].begin());
+    std::copy(spectrum, spectrum + N, maxLevels[0].begin());
+    for(size_t level = 1; level < minLevels.size(); level++) {
+        const std::vector<float> &lowerMin = minLevels[level - 1];
+        const std::vector<float> &lowerMax = maxLevels[level - 1];
+        std::vector<float> &upperMin = minLevels[level];
+        std::vector<float> &upperMax = maxLevels[level];
+        size_t lowerSize = lowerMin.size();
+        for(size_t i = 0; i < upperMin.size(); i++) {
+            size_t j = std::min(2 * i + 1, lowerSize - 1);
+            upperMin[i] = std::min(lowerMin[2 * i], lowerMin[j]);
+            upperMax[i] = std::max(lowerMax[2 * i], lowerMax[j]);
+        }
+    }
+}
+
+unsigned spectrumReducer::reduce(double first, double last, unsigned columns)
+{
+    if(N == 0 || columns == 0) {
+        return 0;
+    }
+
+    first = std::clamp(first, 0.0, static_cast<double>(N - 1));
+    last = std::clamp(last, 0.0, static_cast<double>(N - 1));
+    uint64_t firstBin = static_cast<uint64_t>(std::floor(first));
+    uint64_t lastBin = static_cast<uint64_t>(std::ceil(last));
+    uint64_t span = lastBin - firstBin + 1;
+
+    // Zoomed in beyond bin resolution, every bin is its own column:
+    if(span <= columns) {
+        bins.resize(span);
+        mins.resize(span);
+        maxs.resize(span);
+        for(uint64_t i = 0; i < span; i++) {
+            bins[i] = static_cast<double>(firstBin + i);
+            mins[i] = maxs[i] = minLevels[0][firstBin + i];
+        }
+        return static_cast<unsigned>(span);
+    }
+
+    // Pick the level whose entries are at most one column wide, so each
+    // column touches between one and four entries:
+    double binsPerColumn = static_cast<double>(span) / columns;
+    size_t level = std::min(static_cast<size_t>(std::floor(std::log2(binsPerColumn))), minLevels.size() - 1);
+    const std::vector<float> &levelMin = minLevels[level];
+    const std::vector<float> &levelMax = maxLevels[level];
+
+    bins.resize(columns);
+    mins.resize(columns);
+    maxs.resize(columns);
+    for(unsigned c = 0; c < columns; c++) {
+        double start = static_cast<double>(firstBin) + c * binsPerColumn;
+        double end = start + binsPerColumn;
+        uint64_t i0 = static_cast<uint64_t>(start) >> level;
+        uint64_t i1 = std::min<uint64_t>(static_cast<uint64_t>(std::ceil(end)) - 1, N - 1) >> level;
+
+        float lo = levelMin[i0];
+        float hi = levelMax[i0];
+        for(uint64_t i = i0 + 1; i <= i1; i++) {
+            lo = std::min(lo, levelMin[i]);
+            hi = std::max(hi, levelMax[i]);
+        }
+        bins[c] = (start + end) / 2.0 - 0.5;
+        mins[c] = lo;
+        maxs[c] = hi;
+    }
+    return columns;
+}
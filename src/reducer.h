@@ -0,0 +1,35 @@
+#ifndef REDUCER_H
+#define REDUCER_H
+
+#include <cstdint>
+#include <vector>
+
+// Peak preserving reduction of a spectrum to display resolution.
+// build() keeps a min/max pyramid (level k merges 2^k bins) of the current
+// spectrum, reduce() then turns any visible bin range into per pixel
+// min/max columns touching only a few pyramid entries per column, so
+// zooming and panning cost O(pixels) instead of O(bins).
+class spectrumReducer {
+    public:
+    void build(const float *spectrum, uint64_t N);
+
+    // Reduces the bins [first, last] to at most `columns` columns and
+    // returns the number of columns. Narrower ranges yield one column per bin.
+    unsigned reduce(double first, double last, unsigned columns);
+
+    // Column centers in (fractional) bins, and the envelope per column:
+    double* getBins() { return bins.data(); }
+    const double* getMin() { return mins.data(); }
+    const double* getMax() { return maxs.data(); }
+
+    private:
+    uint64_t N = 0;
+    std::vector<std::vector<float>> minLevels;
+    std::vector<std::vector<float>> maxLevels;
+
+    std::vector<double> bins;
+    std::vector<double> mins;
+    std::vector<double> maxs;
+};
+
+#endif
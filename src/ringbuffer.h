@@ -0,0 +1,106 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Lock-free single producer / single consumer ring.
+// The slots are allocated once and filled in place (writeSlot/readSlot) or
+// copied in bulk (push/pop), so neither side allocates while streaming.
+// If the consumer falls behind, the producer drops the new elements and
+// counts an overrun instead of blocking.
+template <typename T>
+class ringBuffer {
+    public:
+    ringBuffer(size_t capacity, const T& prototype = T())
+        : slots(capacity + 1, prototype), head(0), tail(0), overruns(0) {}
+
+    // Producer: returns the next free slot or nullptr if the ring is full
+    T* writeSlot()
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (next(h) == tail.load(std::memory_order_acquire)) {
+            overruns.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &slots[h];
+    }
+
+    // Producer: publishes the slot returned by writeSlot()
+    void commitWrite()
+    {
+        head.store(next(head.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+    // Consumer: returns the oldest filled slot or nullptr if the ring is empty
+    T* readSlot()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[t];
+    }
+
+    // Consumer: hands the slot returned by readSlot() back to the producer
+    void commitRead()
+    {
+        tail.store(next(tail.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+    // Producer: copies up to n elements, returns how many fitted
+    size_t push(const T *data, size_t n)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        size_t free = (t + slots.size() - h - 1) % slots.size();
+        if(n > free) {
+            overruns.fetch_add(1, std::memory_order_relaxed);
+            n = free;
+        }
+        size_t first = std::min(n, slots.size() - h);
+        std::copy(data, data + first, slots.begin() + h);
+        std::copy(data + first, data + n, slots.begin());
+        head.store((h + n) % slots.size(), std::memory_order_release);
+        return n;
+    }
+
+    // Consumer: copies up to n elements out, returns how many were available
+    size_t pop(T *data, size_t n)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        size_t used = (h + slots.size() - t) % slots.size();
+        n = std::min(n, used);
+        size_t first = std::min(n, slots.size() - t);
+        std::copy(slots.begin() + t, slots.begin() + t + first, data);
+        std::copy(slots.begin(), slots.begin() + (n - first), data + first);
+        tail.store((t + n) % slots.size(), std::memory_order_release);
+        return n;
+    }
+
+    size_t size() const
+    {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return (h + slots.size() - t) % slots.size();
+    }
+
+    size_t capacity() const { return slots.size() - 1; }
+    uint64_t getOverruns() const { return overruns.load(std::memory_order_relaxed); }
+
+    private:
+    size_t next(size_t i) const { return (i + 1) % slots.size(); }
+
+    std::vector<T> slots;
+
+    // Keep the indices on separate cache lines, producer and consumer
+    // run on different cores:
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) std::atomic<uint64_t> overruns;
+};
+
+#endif
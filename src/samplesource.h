@@ -0,0 +1,27 @@
+#ifndef SAMPLESOURCE_H
+#define SAMPLESOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Anything the acquisition thread can draw IQ samples from: the Pluto, the
+// synthetic band and file playback. read() fills a pooled block directly,
+// which is then lent to every consumer without further copies.
+class sampleSource {
+    public:
+    virtual ~sampleSource() {}
+
+    // Fills up to `count` interleaved int16 IQ samples, returns how many,
+    // 0 if nothing is available right now:
+    virtual size_t read(int16_t *out, size_t count) = 0;
+    virtual double getSampleRate() = 0;
+
+    // Paced sources block in read() at the device rate, the others are
+    // paced by the acquisition thread as long as they run in real time.
+    // An unpaced source waits for the slowest consumer instead of
+    // dropping blocks.
+    virtual bool isPaced() { return false; }
+    virtual bool getRealtime() { return true; }
+};
+
+#endif
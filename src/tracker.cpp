@@ -0,0 +1,303 @@
+#include "tracker.h"
+#include "iqconvert.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+
+beaconTracker::beaconTracker(iqRing *ring, frequencyPlan *plan, uint64_t blockSize) :
+    plan(plan),
+    blockSize(blockSize),
+    ring(ring),
+    running(false),
+    expectedSequence(0),
+    nominal(0.0),
+    mixerOffset(0.0),
+    retune(false),
+    stagedCount(0),
+    forward(nullptr),
+    acquisitionCount(0),
+    bin(0.0),
+    previousBin(0.0),
+    havePrevious(false),
+    windowPower(0.0),
+    windowCount(0),
+    misses(0),
+    enabled(false),
+    txCorrected(false),
+    searchRange(2'000.0),
+    current(OFF),
+    offset(0.0),
+    rawOffset(0.0),
+    coherence(0.0),
+    locks(0)
+{
+    channelRate = plan->getSampleRate() / decimation;
+
+    // Only the beacon's few hundred Hz are needed, a long Kaiser decimator
+    // keeps the neighbouring segments out:
+    decimator = firdecim_crcf_create_kaiser(decimation, 4, 60.0f);
+    staged.resize(blockSize + decimation);
+    decimated.resize(staged.size() / decimation + 1);
+
+    acquisition = (complex*) fftwTraits<float>::malloc(sizeof(complex) * acquisitionSize);
+    spectrum = (complex*) fftwTraits<float>::malloc(sizeof(complex) * acquisitionSize);
+
+    metrics &registry = metrics::instance();
+    registry.addProbe(this, "beacon_state", "0 off, 1 searching, 2 locked, 3 out of band", [this]() { return static_cast<double>(current.load()); });
+    registry.addProbe(this, "beacon_offset_hz", "Smoothed beacon offset (LNB drift)", [this]() { return offset.load(); });
+    registry.addProbe(this, "beacon_coherence", "Beacon tone power over window power", [this]() { return coherence.load(); });
+
+    running = true;
+    trackerThread = std::thread(&beaconTracker::run, this);
+}
+
+beaconTracker::~beaconTracker()
+{
+    metrics::instance().removeProbes(this);
+    running = false;
+    if(trackerThread.joinable()) {
+        trackerThread.join();
+    }
+    firdecim_crcf_destroy(decimator);
+    fftwTraits<float>::free(acquisition);
+    fftwTraits<float>::free(spectrum);
+}
+
+void beaconTracker::setEnabled(bool on)
+{
+    enabled = on;
+}
+
+// Runs on the tracker thread, always drains the ring so it never counts as
+// an overrun. The thread is the only writer of the plan's correction.
+void beaconTracker::run()
+{
+    forward = fftPlanner<float>::instance().getPlan(acquisitionSize, FFTW_FORWARD);
+
+    while(running) {
+        iqBlock *slot = ring->readSlot();
+        if(slot == nullptr) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        iqBlock block = std::move(*slot);
+        ring->commitRead();
+
+        if(!enabled) {
+            if(current != OFF) {
+                current = OFF;
+                offset = 0.0;
+                rawOffset = 0.0;
+                coherence = 0.0;
+                plan->setCorrection(0.0);
+            }
+            continue;
+        }
+        if(current == OFF) {
+            mixerOffset = 0.0;
+            nominal = plan->toBaseband(beaconFrequency);
+            retune = true;
+            restart(SEARCHING);
+        }
+        process(block);
+    }
+}
+
+void beaconTracker::restart(state s)
+{
+    current = s;
+    acquisitionCount = 0;
+    havePrevious = false;
+    bin = 0.0;
+    s1 = s2 = 0.0;
+    windowPower = 0.0;
+    windowCount = 0;
+    misses = 0;
+}
+
+void beaconTracker::process(const iqBlock &block)
+{
+    static histogram &trackTime = metrics::instance().getHistogram("beacon_track", "Beacon tracker per block");
+    scopedTimer timer(trackTime);
+
+    // A retuned center moves the beacon, the drift stays what it was:
+    double expected = plan->toBaseband(beaconFrequency);
+    if(expected != nominal) {
+        nominal = expected;
+        retune = true;
+        restart(SEARCHING);
+    }
+    double margin = searchRange + channelRate / 2.0;
+    if(std::abs(nominal + mixerOffset) + margin > plan->getSampleRate() / 2.0) {
+        if(current != OUT_OF_BAND) {
+            restart(OUT_OF_BAND);
+        }
+        return;
+    }
+    if(current == OUT_OF_BAND) {
+        restart(SEARCHING);
+    }
+
+    // Lost blocks break the phase of the Goertzel windows:
+    uint64_t sequence = block.getSequence();
+    if(sequence != expectedSequence) {
+        havePrevious = false;
+        s1 = s2 = 0.0;
+        windowPower = 0.0;
+        windowCount = 0;
+        acquisitionCount = 0;
+    }
+    expectedSequence = sequence + 1;
+
+    // The mixer only moves at block boundaries, the window in flight is
+    // dropped then:
+    if(retune) {
+        retune = false;
+        mixer.setFrequency(nominal + mixerOffset, plan->getSampleRate());
+        s1 = s2 = 0.0;
+        windowPower = 0.0;
+        windowCount = 0;
+    }
+
+    std::complex<float> *in = staged.data() + stagedCount;
+    convertIq(block.samples(), blockSize, reinterpret_cast<float*>(in));
+    mixer.mixDown(in, in, blockSize);
+    stagedCount += blockSize;
+
+    size_t count = stagedCount / decimation;
+    firdecim_crcf_execute_block(decimator, staged.data(), static_cast<unsigned int>(count), decimated.data());
+    std::copy(staged.begin() + count * decimation, staged.begin() + stagedCount, staged.begin());
+    stagedCount -= count * decimation;
+
+    double coefficient = 2.0 * std::cos(2.0 * M_PI * bin / channelRate);
+    for(size_t k = 0; k < count; k++) {
+        // Squaring removes the BPSK phase flips:
+        std::complex<double> x = std::complex<double>(decimated[k]) * std::complex<double>(decimated[k]);
+
+        if(current == SEARCHING) {
+            reinterpret_cast<std::complex<float>*>(acquisition)[acquisitionCount++] = std::complex<float>(x);
+            if(acquisitionCount == acquisitionSize) {
+                search();
+                coefficient = 2.0 * std::cos(2.0 * M_PI * bin / channelRate);
+                if(retune) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        std::complex<double> s0 = x + coefficient * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+        windowPower += std::abs(x);
+        if(++windowCount == windowSize) {
+            // DFT bin referenced to the first sample of the window:
+            double omega = 2.0 * M_PI * bin / channelRate;
+            std::complex<double> y = s1 - std::polar(1.0, -omega) * s2;
+            track(y * std::polar(1.0, -omega * (windowSize - 1)), windowPower);
+            coefficient = 2.0 * std::cos(2.0 * M_PI * bin / channelRate);
+            s1 = s2 = 0.0;
+            windowPower = 0.0;
+            windowCount = 0;
+            if(retune || current != LOCKED) {
+                break;
+            }
+        }
+    }
+}
+
+// Coarse acquisition: strongest line of the squared signal in the range
+void beaconTracker::search()
+{
+    acquisitionCount = 0;
+
+    std::complex<float> *x = reinterpret_cast<std::complex<float>*>(acquisition);
+    for(uint64_t n = 0; n < acquisitionSize; n++) {
+        x[n] *= static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * n / acquisitionSize)); // Hann
+    }
+    fftwTraits<float>::execute(forward, acquisition, spectrum);
+    std::complex<float> *X = reinterpret_cast<std::complex<float>*>(spectrum);
+
+    // Twice the offset after squaring, below the decimated Nyquist:
+    double range = std::min(2.0 * searchRange, 0.45 * channelRate);
+    int64_t bins = static_cast<int64_t>(range * acquisitionSize / channelRate);
+    auto power = [&](int64_t k) { return std::norm(X[(k + acquisitionSize) % acquisitionSize]); };
+    int64_t peak = 0;
+    double peakPower = 0.0;
+    double sum = 0.0;
+    for(int64_t k = -bins; k <= bins; k++) {
+        double p = power(k);
+        sum += p;
+        if(p > peakPower) {
+            peakPower = p;
+            peak = k;
+        }
+    }
+    double mean = sum / static_cast<double>(2 * bins + 1);
+    if(mean <= 0.0 || peakPower / mean < minQuality) {
+        return;
+    }
+
+    // Parabolic interpolation on the magnitudes:
+    double a = std::sqrt(power(peak - 1));
+    double b = std::sqrt(peakPower);
+    double c = std::sqrt(power(peak + 1));
+    double denominator = a - 2.0 * b + c;
+    double delta = denominator != 0.0 ? 0.5 * (a - c) / denominator : 0.0;
+    double frequency = (static_cast<double>(peak) + delta) * channelRate / acquisitionSize;
+
+    // Center the mixer on the beacon, the Goertzel bin starts at DC:
+    mixerOffset += frequency / 2.0;
+    retune = true;
+    restart(LOCKED);
+    offset = mixerOffset;
+    rawOffset = mixerOffset;
+    plan->setCorrection(mixerOffset);
+    locks++;
+}
+
+// One Goertzel window: the phase advance against the previous window gives
+// the frequency of the squared carrier, unambiguous within +-1 / (2 T)
+void beaconTracker::track(std::complex<double> y, double power)
+{
+    coherence = power > 0.0 ? std::abs(y) / power : 0.0;
+    if(coherence < lockThreshold) {
+        havePrevious = false;
+        if(++misses >= lostWindows) {
+            // Search around the last good estimate:
+            restart(SEARCHING);
+        }
+        return;
+    }
+    misses = 0;
+
+    double duration = static_cast<double>(windowSize) / channelRate;
+    if(havePrevious) {
+        // A window starting at phase theta at bin g has the phase
+        // theta + pi (f - g) (W - 1) / fs, the bin change is taken out:
+        double advance = std::arg(y * std::conj(previous))
+            - M_PI * (windowSize - 1) * (previousBin - bin) / channelRate
+            - 2.0 * M_PI * bin * duration;
+        advance = std::remainder(advance, 2.0 * M_PI);
+        double frequency = bin + advance / (2.0 * M_PI * duration);
+
+        rawOffset = mixerOffset + frequency / 2.0;
+        offset = offset + smoothing * (rawOffset - offset);
+        plan->setCorrection(offset);
+
+        previousBin = bin;
+        bin += loopGain * (frequency - bin);
+    } else {
+        previousBin = bin;
+    }
+    previous = y;
+    havePrevious = true;
+
+    // Far off the mixer the decimator would start to bite, move it:
+    if(std::abs(bin / 2.0) > recenterLimit) {
+        mixerOffset += bin / 2.0;
+        bin = 0.0;
+        havePrevious = false;
+        retune = true;
+    }
+}
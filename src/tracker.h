@@ -0,0 +1,121 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <liquid.h>
+#include "dsp.h"
+#include "fftplanner.h"
+#include "frequencyplan.h"
+#include "iqblock.h"
+
+// Locks onto the QO-100 center beacon and measures the LNB drift. The
+// beacon (the "B" segment at the band center) is mixed to DC and decimated
+// to a few kHz on a background thread fed by its own RX ring. Squaring the
+// narrowband signal strips the BPSK modulation and leaves a carrier at
+// twice the frequency error:
+//
+// SEARCHING: one FFT over ~1.4 s of the squared signal finds the carrier
+//            within +-searchRange Hz.
+// LOCKED:    a single Goertzel bin follows the carrier. The phase advance
+//            of that bin from one window to the next gives the frequency
+//            far below the bin width, a first order loop moves the bin
+//            along and an exponential average smooths the result.
+//
+// While locked the smoothed offset is written to the frequency plan as its
+// correction, which moves the displayed axis and the demodulator NCOs.
+class beaconTracker {
+    public:
+    enum state { OFF, SEARCHING, LOCKED, OUT_OF_BAND };
+
+    beaconTracker(iqRing *ring, frequencyPlan *plan, uint64_t blockSize = 8192);
+    ~beaconTracker();
+
+    // Disabling clears the correction:
+    void setEnabled(bool on);
+    bool isEnabled() { return enabled; }
+    // Beacon offsets of +-range Hz are searched:
+    void setSearchRange(double range) { searchRange = range; }
+    double getSearchRange() { return searchRange; }
+    // Let the uplink follow the correction, only right if the drift comes
+    // from the Pluto's own reference (which both directions share):
+    void setTxCorrected(bool on) { txCorrected = on; }
+    bool isTxCorrected() { return txCorrected; }
+
+    state getState() { return current; }
+    // Smoothed beacon offset from its nominal frequency in Hz:
+    double getOffset() { return offset; }
+    // Last unsmoothed estimate in Hz:
+    double getRawOffset() { return rawOffset; }
+    // Tone power of the last window over its total power, 0 ... 1:
+    double getCoherence() { return coherence; }
+    uint64_t getLocks() { return locks; }
+
+    static constexpr double beaconFrequency = 10'489'750'000.0;
+    static constexpr unsigned int decimation = 48; // 12 kHz
+    static constexpr uint64_t acquisitionSize = 16'384; // 1.37 s
+    static constexpr size_t windowSize = 3'000; // 0.25 s per Goertzel window
+    static constexpr double minQuality = 15.0; // Acquisition peak over mean, noise peaks at ~7
+    static constexpr double lockThreshold = 0.05; // Coherence, noise alone gives ~1 / sqrt(windowSize)
+    static constexpr unsigned int lostWindows = 8;
+    static constexpr double loopGain = 0.5;
+    static constexpr double smoothing = 0.05; // ~5 s time constant
+    static constexpr double recenterLimit = 50.0; // Hz before the mixer moves
+
+    private:
+    void run();
+    void process(const iqBlock &block);
+    void search();
+    void track(std::complex<double> bin, double power);
+    void restart(state s);
+
+    frequencyPlan *plan;
+    uint64_t blockSize;
+    double channelRate;
+
+    // Only touched by the tracker thread:
+    iqRing *ring;
+    std::thread trackerThread;
+    std::atomic<bool> running;
+    uint64_t expectedSequence;
+    double nominal; // Baseband offset of the beacon without correction
+    double mixerOffset; // Correction the mixer runs at
+    bool retune;
+    oscillator mixer;
+    firdecim_crcf decimator;
+    std::vector<std::complex<float>> staged;
+    size_t stagedCount;
+    std::vector<std::complex<float>> decimated;
+
+    // SEARCHING (fftwf_malloc aligned):
+    typedef fftwTraits<float>::complex complex;
+    complex *acquisition;
+    complex *spectrum;
+    fftPlanner<float>::plan forward;
+    uint64_t acquisitionCount;
+
+    // LOCKED, frequencies of the squared signal relative to the mixer:
+    double bin; // Goertzel frequency of the current window
+    double previousBin;
+    std::complex<double> previous;
+    bool havePrevious;
+    std::complex<double> s1;
+    std::complex<double> s2;
+    double windowPower;
+    size_t windowCount;
+    unsigned int misses;
+
+    std::atomic<bool> enabled;
+    std::atomic<bool> txCorrected;
+    std::atomic<double> searchRange;
+    std::atomic<state> current;
+    std::atomic<double> offset;
+    std::atomic<double> rawOffset;
+    std::atomic<double> coherence;
+    std::atomic<uint64_t> locks;
+};
+
+#endif
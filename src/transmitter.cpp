@@ -0,0 +1,323 @@
+#include "transmitter.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+transmitter::transmitter(double sampleRate, uint64_t blockSize) :
+    sampleRate(sampleRate),
+    blockSize(blockSize),
+    stream(nullptr),
+    mic(static_cast<size_t>(0.5 * ssb::audioRate)),
+    micLevel(0.0f),
+    micGain(1.0f),
+    running(false),
+    buffer(nullptr),
+    i(nullptr),
+    modulator(sampleRate),
+    meter(nullptr),
+    pending(0),
+    pendingOffset(0),
+    keyedPower(minPower),
+    ptt(false),
+    current(IDLE),
+    frequency(0.0),
+    correction(0.0),
+    side(ssb::USB),
+    power(-10.0),
+    underruns(0),
+    micUnderruns(0),
+    pushedBlocks(0)
+{
+    blockDuration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(blockSize) / sampleRate)
+    );
+    // The first kernelBuffers blocks go out in one go, all of that DAC time
+    // has to be spoken already, plus the margin:
+    prefill = static_cast<size_t>((kernelBuffers * blockSize / sampleRate + prefillLatency) * ssb::audioRate);
+
+    metrics &registry = metrics::instance();
+    registry.addProbe(this, "tx_state", "0 idle, 1 prefill, 2 keyed, 3 tail", [this]() { return static_cast<double>(current.load()); });
+    registry.addProbe(this, "tx_pushed_blocks", "Blocks pushed to the DAC", [this]() { return pushedBlocks.load(); });
+    registry.addProbe(this, "tx_underruns", "Blocks pushed after the DAC ran dry", [this]() { return underruns.load(); });
+    registry.addProbe(this, "tx_mic_underruns", "Microphone chunks padded with silence", [this]() { return micUnderruns.load(); });
+}
+
+transmitter::~transmitter()
+{
+    metrics::instance().removeProbes(this);
+    stop();
+}
+
+bool transmitter::start(iio_buffer *buffer, iio_channel *i, std::function<bool(double)> setPower)
+{
+    stop();
+
+    PaError err = Pa_Initialize();
+    if (err != paNoError) {
+        std::cout << "ERROR: Cannot open microphone: " << Pa_GetErrorText(err) << std::endl;
+        return false;
+    }
+
+    err = Pa_OpenDefaultStream(&stream,
+                               1,          // mono input
+                               0,          // no output channels
+                               paFloat32,  // 32 bit floating point input
+                               ssb::audioRate,
+                               256,        // frames per buffer
+                               &transmitter::callback,
+                               this);
+    if (err == paNoError) {
+        err = Pa_StartStream(stream);
+        if (err != paNoError) {
+            Pa_CloseStream(stream);
+        }
+    }
+    if (err != paNoError) {
+        std::cout << "ERROR: Cannot open microphone: " << Pa_GetErrorText(err) << std::endl;
+        Pa_Terminate();
+        stream = nullptr;
+        return false;
+    }
+
+    this->buffer = buffer;
+    this->i = i;
+    setPowerCallback = setPower;
+    current = IDLE;
+    ptt = false;
+    key(false);
+
+    running = true;
+    txThread = std::thread(&transmitter::run, this);
+    return true;
+}
+
+void transmitter::stop()
+{
+    running = false;
+    if(txThread.joinable()) {
+        txThread.join();
+    }
+    if(stream != nullptr) {
+        Pa_StopStream(stream);
+        Pa_CloseStream(stream);
+        Pa_Terminate();
+        stream = nullptr;
+    }
+}
+
+int transmitter::callback(const void *input, void * /*output*/, unsigned long frames,
+                          const PaStreamCallbackTimeInfo * /*timeInfo*/,
+                          PaStreamCallbackFlags /*statusFlags*/, void *userData)
+{
+    static_cast<transmitter*>(userData)->capture(static_cast<const float*>(input), frames);
+    return paContinue;
+}
+
+// Runs on the PortAudio thread, must neither lock nor allocate. The level
+// is metered all the time (to set the gain), audio is only kept while the
+// PTT is pressed, so the ring drains once it is released.
+void transmitter::capture(const float *input, unsigned long frames)
+{
+    if(input == nullptr) {
+        return;
+    }
+
+    float gain = micGain;
+    float peak = 0.0f;
+    float scaled[256];
+    for(unsigned long offset = 0; offset < frames; offset += 256) {
+        size_t n = std::min<size_t>(256, frames - offset);
+        for(size_t k = 0; k < n; k++) {
+            scaled[k] = gain * input[offset + k];
+            peak = std::max(peak, std::abs(scaled[k]));
+        }
+        state s = current;
+        if(s == PREFILL || s == KEYED) {
+            mic.push(scaled, n);
+        }
+    }
+    if(peak > micLevel.load(std::memory_order_relaxed)) {
+        micLevel = peak;
+    }
+}
+
+void transmitter::setLatencyMeter(latencyMeter *meter)
+{
+    this->meter = meter;
+    meter->setTxDelay(modulator.getOverrideDelay());
+}
+
+bool transmitter::key(bool on)
+{
+    keyedPower = power;
+    return setPowerCallback(on ? keyedPower : minPower);
+}
+
+// Runs on the TX thread, only leaves IDLE while the PTT is pressed and
+// keeps the DAC fed for as long as it is keyed
+void transmitter::run()
+{
+    auto lastPush = std::chrono::steady_clock::now();
+    unsigned silentBlocks = 0;
+
+    while(running) {
+        state s = current;
+
+        if(s == IDLE) {
+            if(!ptt) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                continue;
+            }
+            // The capture callback only fills the ring from here on, drop
+            // what is left over from the last transmission:
+            float scratch[256];
+            while(mic.pop(scratch, 256) > 0) {}
+            pending = 0;
+            pendingOffset = 0;
+            if(meter != nullptr) {
+                meter->txStart();
+            }
+            current = PREFILL;
+            continue;
+        }
+
+        if(s == PREFILL) {
+            if(!ptt) {
+                current = IDLE;
+                continue;
+            }
+            if(mic.size() < prefill) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                continue;
+            }
+            // The DAC starts with a full queue, only then the TX is keyed:
+            bool queued = true;
+            for(unsigned k = 0; k < kernelBuffers && queued; k++) {
+                queued = push(false);
+            }
+            if(!queued || !key(true)) {
+                std::cout << "ERROR: Cannot key the transmitter" << std::endl;
+                key(false);
+                ptt = false;
+                current = IDLE;
+                continue;
+            }
+            lastPush = std::chrono::steady_clock::now();
+            current = KEYED;
+            continue;
+        }
+
+        // PTT released: send what the microphone buffered, then silence
+        // until the queued blocks played out. Pressed again, carry on.
+        if(s == KEYED && !ptt) {
+            s = current = TAIL;
+            silentBlocks = 0;
+        } else if(s == TAIL && ptt) {
+            s = current = KEYED;
+        }
+        bool silence = s == TAIL && mic.size() < modulator.in.size();
+
+        if(!push(silence)) {
+            key(false);
+            ptt = false;
+            current = IDLE;
+            continue;
+        }
+
+        // After a push the kernel queue is full again, a later push than
+        // that queue lasts means the DAC ran dry in between:
+        auto now = std::chrono::steady_clock::now();
+        if(now - lastPush > kernelBuffers * blockDuration) {
+            underruns++;
+        }
+        lastPush = now;
+
+        if(s == KEYED && power != keyedPower) {
+            key(true);
+        }
+        if(silence && ++silentBlocks >= kernelBuffers) {
+            key(false);
+            current = IDLE;
+        }
+    }
+
+    if(current != IDLE) {
+        key(false);
+        current = IDLE;
+    }
+}
+
+// Modulates the next chunk of microphone audio (or silence)
+void transmitter::modulate(bool silence)
+{
+    size_t chunk = modulator.in.size();
+
+    // The sound card runs ahead of the DAC (clock drift), skip audio
+    // instead of letting the latency grow. Not while the prefilled audio
+    // is queued, the ring is meant to be full then:
+    while(!silence && current != PREFILL && mic.size() > static_cast<size_t>(4.0 * prefillLatency * ssb::audioRate)) {
+        mic.pop(modulator.in.data(), chunk);
+    }
+    size_t count = silence ? 0 : mic.pop(modulator.in.data(), chunk);
+    if(count < chunk) {
+        std::fill(modulator.in.begin() + count, modulator.in.end(), 0.0f);
+        if(!silence) {
+            micUnderruns++;
+        }
+    }
+    const std::complex<float> *probe = nullptr;
+    if(meter != nullptr) {
+        probe = meter->nextProbe(static_cast<size_t>(chunk * ssb::channelRate / ssb::audioRate));
+    }
+    modulator.setSideband(side);
+    pending = modulator.modulate(frequency + correction, chunk, probe);
+    pendingOffset = 0;
+}
+
+// Fills the TX buffer with one block and hands it to the kernel. The push
+// blocks while all kernel buffers are queued, which paces this thread.
+bool transmitter::push(bool silence)
+{
+    static histogram &modulateTime = metrics::instance().getHistogram("tx_modulate", "SSB modulation of one TX block");
+    static histogram &pushTime = metrics::instance().getHistogram("iio_push", "iio_buffer_push, mostly waiting for the DAC");
+
+    size_t count;
+    {
+        scopedTimer timer(modulateTime);
+        char *p_dat = (char *)iio_buffer_first(buffer, i);
+        char *p_end = (char *)iio_buffer_end(buffer);
+        ptrdiff_t p_inc = iio_buffer_step(buffer);
+        count = std::min<size_t>(blockSize, (p_end - p_dat) / p_inc);
+
+        for(size_t n = 0; n < count;) {
+            if(pendingOffset == pending) {
+                modulate(silence);
+            }
+            size_t m = std::min(count - n, pending - pendingOffset);
+            const std::complex<float> *x = modulator.out.data() + pendingOffset;
+            for(size_t k = 0; k < m; k++, p_dat += p_inc) {
+                // The 12 bit DAC takes the upper bits of the int16:
+                ((int16_t*)p_dat)[0] = static_cast<int16_t>(std::clamp(x[k].real(), -1.0f, 1.0f) * 32767.0f); // Real (I)
+                ((int16_t*)p_dat)[1] = static_cast<int16_t>(std::clamp(x[k].imag(), -1.0f, 1.0f) * 32767.0f); // Imag (Q)
+            }
+            n += m;
+            pendingOffset += m;
+        }
+    }
+
+    ssize_t numberOfTxBytes;
+    {
+        scopedTimer timer(pushTime);
+        numberOfTxBytes = iio_buffer_push(buffer);
+    }
+    if(numberOfTxBytes < 0) {
+        std::cout << "ERROR: Error in pushing txBuffer" << std::endl;
+        return false;
+    }
+    pushedBlocks++;
+    if(meter != nullptr) {
+        meter->txPushed(count, kernelBuffers);
+    }
+    return true;
+}
@@ -0,0 +1,123 @@
+#ifndef TRANSMITTER_H
+#define TRANSMITTER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <iio.h>
+#include <portaudio.h>
+#include "dsp.h"
+#include "latency.h"
+#include "ringbuffer.h"
+
+// Continuous SSB uplink. The microphone is captured in PortAudio callback
+// mode into a lock-free ring, the TX thread modulates it up to the Pluto
+// rate and pushes whole blocks to the DAC. The kernel queues
+// `kernelBuffers` pushed blocks: while the DAC plays one, the next ones are
+// already waiting (double buffering), and iio_buffer_push() blocking on a
+// full queue paces the thread. Neither the GUI nor the receiver ever touch
+// this thread.
+//
+// PTT: IDLE -> PREFILL (buffer microphone audio for the whole kernel
+// queue, queue the first blocks while the TX is still attenuated) -> KEYED
+// -> TAIL (send the buffered audio, then silence until the queue played
+// out) -> IDLE.
+class transmitter {
+    public:
+    enum state { IDLE, PREFILL, KEYED, TAIL };
+
+    transmitter(double sampleRate = 576'000.0, uint64_t blockSize = 8192);
+    ~transmitter();
+
+    // Starts capturing and the TX thread on a connected Pluto. `setPower`
+    // sets the TX gain in dB, the transmitter attenuates fully unless keyed:
+    bool start(iio_buffer *buffer, iio_channel *i, std::function<bool(double)> setPower);
+    void stop();
+    bool isRunning() { return running; }
+    // Replaces the audio by its bursts while it measures, set before start():
+    void setLatencyMeter(latencyMeter *meter);
+    latencyMeter* getLatencyMeter() { return meter; }
+
+    void setPtt(bool on) { ptt = on; }
+    bool getPtt() { return ptt; }
+    state getState() { return current; }
+
+    // Offset of the suppressed carrier from the TX center in Hz:
+    void setFrequency(double offset) { frequency = offset; }
+    double getFrequency() { return frequency; }
+    // Added to the offset (reference drift correction), in Hz:
+    void setCorrection(double offset) { correction = offset; }
+    double getCorrection() { return correction; }
+    void setSideband(ssb::sideband s) { side = s; }
+    ssb::sideband getSideband() { return side; }
+    // TX gain while keyed, -89.75 ... 0 dB:
+    void setPower(double dB) { power = dB; }
+    double getPower() { return power; }
+    void setMicGain(float gain) { micGain = gain; }
+    float getMicGain() { return micGain; }
+    // Peak microphone level since the last call:
+    float getMicLevel() { return micLevel.exchange(0.0f); }
+
+    // Blocks pushed too late, the DAC ran dry:
+    uint64_t getUnderruns() { return underruns; }
+    // Blocks the microphone did not deliver in time, sent with silence:
+    uint64_t getMicUnderruns() { return micUnderruns; }
+    uint64_t getPushedBlocks() { return pushedBlocks; }
+
+    static constexpr unsigned kernelBuffers = 4;
+    static constexpr double minPower = -89.75; // dB
+    // Microphone audio buffered before keying on top of what the queued
+    // kernel blocks consume, so the DAC queue starts with speech only:
+    static constexpr double prefillLatency = 0.06; // s
+
+    private:
+    static int callback(const void *input, void *output, unsigned long frames,
+                        const PaStreamCallbackTimeInfo *timeInfo,
+                        PaStreamCallbackFlags statusFlags, void *userData);
+    void capture(const float *input, unsigned long frames);
+
+    void run();
+    bool key(bool on);
+    bool push(bool silence);
+    void modulate(bool silence);
+
+    double sampleRate;
+    uint64_t blockSize;
+    std::chrono::steady_clock::duration blockDuration;
+    size_t prefill; // Microphone samples needed before keying
+
+    // Microphone, written by the PortAudio thread:
+    PaStream *stream;
+    ringBuffer<float> mic;
+    std::atomic<float> micLevel;
+    std::atomic<float> micGain;
+
+    // TX thread:
+    std::thread txThread;
+    std::atomic<bool> running;
+    iio_buffer *buffer;
+    iio_channel *i;
+    std::function<bool(double)> setPowerCallback;
+    ssbModulator modulator;
+    latencyMeter *meter;
+    size_t pending; // Modulated samples not yet copied to the DAC
+    size_t pendingOffset;
+    double keyedPower;
+
+    // Controls:
+    std::atomic<bool> ptt;
+    std::atomic<state> current;
+    std::atomic<double> frequency;
+    std::atomic<double> correction;
+    std::atomic<ssb::sideband> side;
+    std::atomic<double> power;
+
+    std::atomic<uint64_t> underruns;
+    std::atomic<uint64_t> micUnderruns;
+    std::atomic<uint64_t> pushedBlocks;
+};
+
+#endif
@@ -0,0 +1,20 @@
+#include "waterfall.h"
+#include <algorithm>
+
+waterfall::waterfall(uint64_t N, unsigned rows, float range) : N(N), rows(rows), range(range), index(rows - 1)
+{
+    data.assign(static_cast<size_t>(rows) * N, 0);
+}
+
+const uint8_t* waterfall::addRow(const float *spectrum)
+{
+    index = (index + 1) % rows;
+    uint8_t *row = data.data() + static_cast<size_t>(index) * N;
+
+    float scale = 255.0f / range;
+    for(uint64_t n = 0; n < N; n++) {
+        float v = (spectrum[n] + range) * scale;
+        row[n] = static_cast<uint8_t>(std::clamp(v, 0.0f, 255.0f));
+    }
+    return row;
+}
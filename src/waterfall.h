@@ -0,0 +1,32 @@
+#ifndef WATERFALL_H
+#define WATERFALL_H
+
+#include <cstdint>
+#include <vector>
+
+// Host side waterfall ring with one byte per bin. Each dB spectrum is
+// quantized linearly from [-range, 0] dBFS to [0, 255]; colormapping is
+// left to the consumer (the GUI does it in a fragment shader).
+class waterfall {
+    public:
+    waterfall(uint64_t N = 4096, unsigned rows = 256, float range = 156.0f);
+
+    // Quantizes the spectrum into the next row and returns that row
+    const uint8_t* addRow(const float *spectrum);
+
+    // Ring row written last, the oldest row is the next one:
+    unsigned getIndex() { return index; }
+    uint64_t getN() { return N; }
+    unsigned getRows() { return rows; }
+    float getRange() { return range; }
+    const uint8_t* getData() { return data.data(); }
+
+    private:
+    uint64_t N;
+    unsigned rows;
+    float range;
+    unsigned index;
+    std::vector<uint8_t> data;
+};
+
+#endif
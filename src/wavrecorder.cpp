@@ -0,0 +1,126 @@
+#include "wavrecorder.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+wavRecorder::wavRecorder(double sampleRate) :
+    sampleRate(sampleRate),
+    ring(static_cast<size_t>(ringLatency * sampleRate)),
+    recording(false),
+    samples(0),
+    droppedSamples(0)
+{
+}
+
+wavRecorder::~wavRecorder()
+{
+    stop();
+}
+
+// Little endian RIFF header, the sizes are patched in by finish()
+static void writeHeader(std::ofstream &file, double sampleRate, uint32_t dataBytes)
+{
+    auto put16 = [&file](uint16_t v) { char b[2] = {char(v & 0xff), char(v >> 8)}; file.write(b, 2); };
+    auto put32 = [&file](uint32_t v) { char b[4] = {char(v & 0xff), char((v >> 8) & 0xff), char((v >> 16) & 0xff), char(v >> 24)}; file.write(b, 4); };
+    uint32_t rate = static_cast<uint32_t>(sampleRate);
+
+    file.write("RIFF", 4);
+    put32(36 + dataBytes);
+    file.write("WAVE", 4);
+    file.write("fmt ", 4);
+    put32(16);
+    put16(1); // PCM
+    put16(1); // Mono
+    put32(rate);
+    put32(rate * 2); // Bytes per second
+    put16(2); // Bytes per frame
+    put16(16); // Bits per sample
+    file.write("data", 4);
+    put32(dataBytes);
+}
+
+bool wavRecorder::start(const std::string &path)
+{
+    if(recording) {
+        std::cout << "ERROR: Audio recorder is still busy with " << this->path << std::endl;
+        return false;
+    }
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if(!file) {
+        std::cout << "ERROR: Cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    writeHeader(file, sampleRate, 0);
+
+    // Left over from the last recording (pushed after its final drain):
+    float scratch[256];
+    while(ring.pop(scratch, 256) > 0) {}
+
+    this->path = path;
+    samples = 0;
+    droppedSamples = 0;
+    recording = true;
+    writer = std::thread(&wavRecorder::run, this);
+    return true;
+}
+
+void wavRecorder::stop()
+{
+    if(!recording) {
+        return;
+    }
+    recording = false;
+    if(writer.joinable()) {
+        writer.join();
+    }
+    drain();
+    finish();
+}
+
+void wavRecorder::write(const float *samples, size_t count)
+{
+    if(!recording) {
+        return;
+    }
+    size_t pushed = ring.push(samples, count);
+    if(pushed < count) {
+        droppedSamples += count - pushed;
+    }
+}
+
+// Runs on the writer thread while recording
+void wavRecorder::run()
+{
+    while(recording) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+}
+
+void wavRecorder::drain()
+{
+    float in[1024];
+    int16_t out[1024];
+    size_t n;
+    while((n = ring.pop(in, 1024)) > 0) {
+        for(size_t k = 0; k < n; k++) {
+            out[k] = static_cast<int16_t>(std::clamp(in[k], -1.0f, 1.0f) * 32767.0f);
+        }
+        // WAV is little endian, like every host this runs on:
+        file.write(reinterpret_cast<const char*>(out), n * sizeof(int16_t));
+        samples += n;
+    }
+}
+
+void wavRecorder::finish()
+{
+    file.seekp(0);
+    writeHeader(file, sampleRate, static_cast<uint32_t>(samples * sizeof(int16_t)));
+    file.close();
+    if(!file) {
+        std::cout << "ERROR: Writing " << path << " failed" << std::endl;
+    }
+}
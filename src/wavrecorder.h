@@ -0,0 +1,49 @@
+#ifndef WAVRECORDER_H
+#define WAVRECORDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include "ringbuffer.h"
+
+// Demodulated audio to a 16 bit mono WAV file. write() runs on the audio
+// thread and only copies into a lock-free ring, a writer thread (running
+// while recording) converts and writes to disk, so a slow disk costs
+// dropped samples (counted) but never stalls the demodulator.
+class wavRecorder {
+    public:
+    wavRecorder(double sampleRate = 48'000.0);
+    ~wavRecorder();
+
+    bool start(const std::string &path);
+    void stop();
+    bool isRecording() { return recording; }
+    std::string getPath() { return path; }
+
+    // Producer side, called from the audio thread:
+    void write(const float *samples, size_t count);
+
+    uint64_t getSamples() { return samples; }
+    uint64_t getDroppedSamples() { return droppedSamples; }
+
+    static constexpr double ringLatency = 2.0; // s the ring bridges
+
+    private:
+    void run();
+    void drain();
+    void finish();
+
+    double sampleRate;
+    ringBuffer<float> ring;
+    std::thread writer;
+    std::ofstream file;
+    std::string path;
+    std::atomic<bool> recording;
+
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> droppedSamples;
+};
+
+#endif
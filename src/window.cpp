@@ -0,0 +1,105 @@
+#include "window.h"
+#include <cmath>
+
+windowFunction::windowFunction(uint64_t N, type t, double beta, bool shift) : N(N), t(t), beta(beta), shift(shift)
+{
+    coefficients.resize(N);
+    coefficientsFloat.resize(N);
+    compute();
+}
+
+void windowFunction::setType(type t, double beta)
+{
+    if(t == this->t && beta == this->beta) {
+        return;
+    }
+    this->t = t;
+    this->beta = beta;
+    compute();
+}
+
+void windowFunction::apply(fftw_complex *samples)
+{
+    const double *w = coefficients.data();
+    for(uint64_t i = 0; i < N; i++) {
+        samples[i][0] *= w[i];
+        samples[i][1] *= w[i];
+    }
+}
+
+void windowFunction::apply(fftwf_complex *samples)
+{
+    const float *w = coefficientsFloat.data();
+    for(uint64_t i = 0; i < N; i++) {
+        samples[i][0] *= w[i];
+        samples[i][1] *= w[i];
+    }
+}
+
+const char* windowFunction::name(type t)
+{
+    switch(t) {
+        case HAMMING: return "Hamming";
+        case HANN: return "Hann";
+        case BLACKMAN_HARRIS: return "Blackman-Harris";
+        case FLAT_TOP: return "Flat-Top";
+        case KAISER: return "Kaiser";
+    }
+    return "";
+}
+
+// Modified Bessel function of the first kind, order 0 (power series)
+double windowFunction::besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    double y = x * x / 4.0;
+    for(int k = 1; k < 50; k++) {
+        term *= y / (static_cast<double>(k) * static_cast<double>(k));
+        sum += term;
+        if(term < sum * 1e-16) {
+            break;
+        }
+    }
+    return sum;
+}
+
+void windowFunction::compute()
+{
+    // Periodic (DFT-even) windows, see https://de.wikipedia.org/wiki/Fensterfunktion
+    double sum = 0.0;
+    double sumSquared = 0.0;
+    for(uint64_t i = 0; i < N; i++) {
+        double x = 2.0 * M_PI * static_cast<double>(i) / static_cast<double>(N);
+        double w = 0.0;
+        switch(t) {
+            case HAMMING:
+                w = 0.54 - 0.46 * cos(x);
+                break;
+            case HANN:
+                w = 0.5 - 0.5 * cos(x);
+                break;
+            case BLACKMAN_HARRIS:
+                w = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+                break;
+            case FLAT_TOP:
+                w = 0.21557895 - 0.41663158 * cos(x) + 0.277263158 * cos(2.0 * x)
+                  - 0.083578947 * cos(3.0 * x) + 0.006947368 * cos(4.0 * x);
+                break;
+            case KAISER: {
+                double r = 2.0 * static_cast<double>(i) / static_cast<double>(N) - 1.0;
+                w = besselI0(beta * sqrt(1.0 - r * r)) / besselI0(beta);
+                break;
+            }
+        }
+        sum += w;
+        sumSquared += w * w;
+
+        // Multiplying with (-1)^n shifts the spectrum by N/2 bins:
+        coefficients[i] = (shift && (i & 1)) ? -w : w;
+        coefficientsFloat[i] = static_cast<float>(coefficients[i]);
+    }
+
+    coherentGain = sum / static_cast<double>(N);
+    noiseEquivalentBandwidth = static_cast<double>(N) * sumSquared / (sum * sum);
+}
@@ -0,0 +1,47 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <cstdint>
+#include <vector>
+#include <fftw3.h>
+
+// Precomputed FFT window. The coefficient table is computed once per
+// type/N/beta and can fold the fftshift into the input by multiplying with
+// (-1)^n, so the FFT output comes out with DC already in the center.
+class windowFunction {
+    public:
+    enum type { HAMMING, HANN, BLACKMAN_HARRIS, FLAT_TOP, KAISER };
+
+    windowFunction(uint64_t N = 4096, type t = BLACKMAN_HARRIS, double beta = 8.6, bool shift = true);
+    void setType(type t, double beta = 8.6);
+    void apply(fftw_complex *samples);
+    void apply(fftwf_complex *samples);
+
+    type getType() { return t; }
+    double getBeta() { return beta; }
+    const std::vector<double>& getCoefficients() { return coefficients; }
+
+    // Amplitude gain for a bin-centered tone, sum(w)/N:
+    double getCoherentGain() { return coherentGain; }
+
+    // Noise equivalent bandwidth in bins, N*sum(w^2)/sum(w)^2:
+    double getNoiseEquivalentBandwidth() { return noiseEquivalentBandwidth; }
+
+    static const char* name(type t);
+    static constexpr int count = 5;
+
+    private:
+    void compute();
+    static double besselI0(double x);
+
+    uint64_t N;
+    type t;
+    double beta;
+    bool shift;
+    std::vector<double> coefficients;
+    std::vector<float> coefficientsFloat;
+    double coherentGain;
+    double noiseEquivalentBandwidth;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "zoom.h"
+#include "iqconvert.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+zoomSpectrum::zoomSpectrum(iqRing *ring, frequencyPlan *plan, uint64_t blockSize) :
+    plan(plan),
+    blockSize(blockSize),
+    ring(ring),
+    running(false),
+    activeFactor(0),
+    activeN(0),
+    activeCenter(0.0),
+    decimator(nullptr),
+    stagedCount(0),
+    frameFill(0),
+    fftIn(nullptr),
+    fftOut(nullptr),
+    forward(nullptr),
+    planGeneration(0),
+    resultCenter(0.0),
+    resultBinWidth(0.0),
+    generation(0),
+    enabled(false),
+    center(0.0),
+    factor(64),
+    N(1024)
+{
+    running = true;
+    zoomThread = std::thread(&zoomSpectrum::run, this);
+}
+
+zoomSpectrum::~zoomSpectrum()
+{
+    running = false;
+    if(zoomThread.joinable()) {
+        zoomThread.join();
+    }
+    if(decimator != nullptr) {
+        firdecim_crcf_destroy(decimator);
+    }
+    fftwTraits<float>::free(fftIn);
+    fftwTraits<float>::free(fftOut);
+}
+
+void zoomSpectrum::setFactor(unsigned int factor)
+{
+    this->factor = std::clamp(factor, minFactor, maxFactor);
+}
+
+void zoomSpectrum::setN(uint64_t N)
+{
+    this->N = std::clamp(N, minN, maxN);
+}
+
+uint64_t zoomSpectrum::getSpectrum(uint64_t generation, std::vector<float> &spectrum, double &center, double &binWidth)
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    if(this->generation != generation) {
+        spectrum = result;
+        center = resultCenter;
+        binWidth = resultBinWidth;
+    }
+    return this->generation;
+}
+
+// Runs on the zoom thread, always drains the ring so it never counts as an
+// overrun, and only does work while enabled
+void zoomSpectrum::run()
+{
+    while(running) {
+        iqBlock *slot = ring->readSlot();
+        if(slot == nullptr) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        iqBlock block = std::move(*slot);
+        ring->commitRead();
+
+        if(enabled) {
+            configure();
+            process(block);
+        }
+    }
+}
+
+// Applies factor and N changes, the frame in flight is dropped
+void zoomSpectrum::configure()
+{
+    unsigned int f = factor;
+    uint64_t n = N;
+    if(f != activeFactor) {
+        activeFactor = f;
+        if(decimator != nullptr) {
+            firdecim_crcf_destroy(decimator);
+        }
+        // Cut off at the span edges, the window hides the little that
+        // aliases in from the transition band:
+        std::vector<float> taps = kaiserLowpass(8 * f + 1, 0.5f / f, 1.0f);
+        decimator = firdecim_crcf_create(f, taps.data(), static_cast<unsigned int>(taps.size()));
+        staged.resize(blockSize + f);
+        decimated.resize(staged.size() / f + 1);
+        stagedCount = 0;
+        frameFill = 0;
+    }
+    if(n != activeN) {
+        activeN = n;
+        fftwTraits<float>::free(fftIn);
+        fftwTraits<float>::free(fftOut);
+        fftIn = (complex*) fftwTraits<float>::malloc(sizeof(complex) * n);
+        fftOut = (complex*) fftwTraits<float>::malloc(sizeof(complex) * n);
+        // Never measures on this thread, it has to keep draining the ring:
+        planGeneration = fftPlanner<float>::instance().getGeneration();
+        forward = fftPlanner<float>::instance().getPlanNow(n, FFTW_FORWARD);
+        // The window also does the fftshift:
+        taper = windowFunction(n, windowFunction::BLACKMAN_HARRIS);
+        spectrum.resize(n);
+        frame.assign(n, 0.0f);
+        frameFill = 0;
+    }
+}
+
+void zoomSpectrum::process(const iqBlock &block)
+{
+    static histogram &zoomTime = metrics::instance().getHistogram("zoom", "Zoom mix, decimation and FFT per block");
+    scopedTimer timer(zoomTime);
+
+    // A new center starts a new frame, so none mixes two regions:
+    double c = center;
+    if(c != activeCenter) {
+        activeCenter = c;
+        frameFill = 0;
+    }
+    mixer.setFrequency(c + plan->getCorrection(), plan->getSampleRate());
+
+    std::complex<float> *in = staged.data() + stagedCount;
+    convertIq(block.samples(), blockSize, reinterpret_cast<float*>(in));
+    mixer.mixDown(in, in, blockSize);
+    stagedCount += blockSize;
+
+    size_t count = stagedCount / activeFactor;
+    firdecim_crcf_execute_block(decimator, staged.data(), static_cast<unsigned int>(count), decimated.data());
+    std::copy(staged.begin() + count * activeFactor, staged.begin() + stagedCount, staged.begin());
+    stagedCount -= count * activeFactor;
+
+    // Frames overlap by half, the window would waste the rest:
+    for(size_t k = 0; k < count;) {
+        size_t n = std::min(count - k, activeN - frameFill);
+        std::copy(decimated.begin() + k, decimated.begin() + k + n, frame.begin() + frameFill);
+        frameFill += n;
+        k += n;
+        if(frameFill < activeN) {
+            break;
+        }
+
+        // A measured plan replaced the estimated one:
+        uint64_t latest = fftPlanner<float>::instance().getGeneration();
+        if(latest != planGeneration) {
+            planGeneration = latest;
+            forward = fftPlanner<float>::instance().getPlanNow(activeN, FFTW_FORWARD);
+        }
+
+        std::copy(frame.begin(), frame.end(), reinterpret_cast<std::complex<float>*>(fftIn));
+        taper.apply(fftIn);
+        fftwTraits<float>::execute(forward, fftIn, fftOut);
+
+        // dBFS like the main spectrum, a full scale tone reads 0 dB:
+        float offset = static_cast<float>(20.0 * std::log10(static_cast<double>(activeN) * taper.getCoherentGain()));
+        for(uint64_t b = 0; b < activeN; b++) {
+            float power = fftOut[b][0] * fftOut[b][0] + fftOut[b][1] * fftOut[b][1] + std::numeric_limits<float>::min();
+            spectrum[b] = 10.0f * std::log10(power) - offset;
+        }
+        {
+            std::lock_guard<std::mutex> lock(resultMutex);
+            result = spectrum;
+            resultCenter = activeCenter;
+            resultBinWidth = plan->getSampleRate() / activeFactor / static_cast<double>(activeN);
+            generation++;
+        }
+
+        std::copy(frame.begin() + activeN / 2, frame.end(), frame.begin());
+        frameFill = activeN / 2;
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef ZOOM_H
+#define ZOOM_H
+
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <liquid.h>
+#include "dsp.h"
+#include "fftplanner.h"
+#include "frequencyplan.h"
+#include "iqblock.h"
+#include "window.h"
+
+// Zoom FFT around the VFO. On its own RX ring and thread the region is
+// mixed to DC, decimated by `factor` and transformed by a small FFT, so a
+// span of sampleRate / factor gets N bins of a few Hz, for a full rate
+// mix, one decimator and a small FFT per N / 2 decimated samples (frames
+// overlap by half). Raising the global N to the same resolution would cost
+// a huge FFT per frame. Factor and N can change live, the center follows
+// the VFO without resetting anything else.
+class zoomSpectrum {
+    public:
+    zoomSpectrum(iqRing *ring, frequencyPlan *plan, uint64_t blockSize = 8192);
+    ~zoomSpectrum();
+
+    // Only runs while enabled (e.g. the panel is open):
+    void setEnabled(bool on) { enabled = on; }
+    bool isEnabled() { return enabled; }
+    // Offset of the zoom center from the band center in Hz, without the
+    // plan's correction (like the carrier):
+    void setCenter(double offset) { center = offset; }
+    double getCenter() { return center; }
+    // Decimation, the span is sampleRate / factor:
+    void setFactor(unsigned int factor);
+    unsigned int getFactor() { return factor; }
+    void setN(uint64_t N);
+    uint64_t getN() { return N; }
+    double getSpan() { return plan->getSampleRate() / factor; }
+    double getBinWidth() { return getSpan() / static_cast<double>(N); }
+
+    // Copies the newest spectrum (dBFS, DC in the middle) if it is newer
+    // than `generation` and returns its generation. `center` and `binWidth`
+    // are the ones the spectrum was made with.
+    uint64_t getSpectrum(uint64_t generation, std::vector<float> &spectrum, double &center, double &binWidth);
+
+    static constexpr unsigned int minFactor = 8;
+    static constexpr unsigned int maxFactor = 512;
+    static constexpr uint64_t minN = 256;
+    static constexpr uint64_t maxN = 8192;
+
+    private:
+    void run();
+    void configure();
+    void process(const iqBlock &block);
+
+    frequencyPlan *plan;
+    uint64_t blockSize;
+
+    // Only touched by the zoom thread:
+    iqRing *ring;
+    std::thread zoomThread;
+    std::atomic<bool> running;
+    unsigned int activeFactor;
+    uint64_t activeN;
+    double activeCenter;
+    oscillator mixer;
+    firdecim_crcf decimator;
+    std::vector<std::complex<float>> staged;
+    size_t stagedCount;
+    std::vector<std::complex<float>> decimated;
+    std::vector<std::complex<float>> frame;
+    size_t frameFill;
+
+    // Own FFT instead of an fft<float>, whose timers belong to the main
+    // spectrum (fftwf_malloc aligned):
+    typedef fftwTraits<float>::complex complex;
+    complex *fftIn;
+    complex *fftOut;
+    fftPlanner<float>::plan forward;
+    uint64_t planGeneration;
+    windowFunction taper;
+    std::vector<float> spectrum;
+
+    // Newest spectrum, handed to the GUI:
+    std::mutex resultMutex;
+    std::vector<float> result;
+    double resultCenter;
+    double resultBinWidth;
+    uint64_t generation;
+
+    std::atomic<bool> enabled;
+    std::atomic<double> center;
+    std::atomic<unsigned int> factor;
+    std::atomic<uint64_t> N;
+};
+
+#endif